@@ -0,0 +1,697 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+    Transport benchmark against the simulated controller.
+
+    Measures the connect handshake and parameter snapshot, the latency from a move command
+    to the first sign of motion, the status poll throughput and an autofocus style sequence
+    of small moves, each waited for and followed by a status poll, and long slews.
+
+    Moves use the driver's default speed profiles when the firmware has them, -c keeps the
+    constant speed instead. -a keeps the ASCII framing.
+
+    -s runs a soak test of that many operations instead: absolute and relative moves, stops
+    and settings read back, mixed by the weights of -m and submitted asynchronously at -r
+    operations per second (0 for back to back, at most -q outstanding). A status poll runs
+    every -p milliseconds meanwhile, like the driver's timer. Results are printed as JSON,
+    to -o if given.
+
+    Usage: astrostep_bench [-b baud] [-l latency_us] [-j jitter_us] [-v version] [-n runs] [-a] [-c]
+                           [-s operations [-r rate] [-q depth] [-m abs,rel,stop,config] [-p poll_ms] [-o file]]
+*/
+
+#include "astrostep_io.h"
+#include "astrostep_reply.h"
+#include "astrostep_simulator.h"
+#include "astrostep_stats.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include <poll.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static uint32_t elapsedMicros(Clock::time_point start)
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+}
+
+/**
+ * @brief The BenchClient class drives the controller protocol through an IOLoop, like the driver.
+ */
+class BenchClient
+{
+    public:
+        bool open(int fd)
+        {
+            io.setEventHandler([this](const char * frame)
+            {
+                ReplyParser::Values values;
+                if (ReplyParser::parseEvent(frame, values))
+                {
+                    events++;
+                    streamMoving = values.get(ReplyParser::FIELD_MOVING) == 1;
+                }
+            });
+            return io.open(fd);
+        }
+
+        void close()
+        {
+            io.close();
+        }
+
+        // Handshake and the seven parameter reads of GetFocusParams.
+        bool connect()
+        {
+            char res[IORequest::MAX_LENGTH] = {0};
+            io.setBinary(false);
+            if (!query(":GV#", res) || !ReplyParser::parseVersion(res, version))
+                return false;
+
+            io.setPipelined(version >= 200);
+            streaming = version >= 500;
+            io.setBinary(binary && version >= 700);
+
+            // Same profiles as the driver defaults
+            profiles = useProfiles && version >= 800;
+            selectedProfile = -1;
+            if (profiles && (!query(":SY1,3200,4000#") || !query(":SY2,800,16000#")))
+                return false;
+
+            auto request = std::make_shared<IORequest>();
+            for (const char * cmd : { ":GP#", ":GT#", ":GD#", ":GE#", ":GO#", ":GC#", ":GR#" })
+                request->add(cmd);
+            return io.execute(request) == IORequest::IO_OK;
+        }
+
+        bool query(const char * cmd, char * res = nullptr)
+        {
+            auto request = std::make_shared<IORequest>();
+            request->add(cmd, res != nullptr);
+            if (io.execute(request) != IORequest::IO_OK)
+                return false;
+            if (res)
+                memcpy(res, request->res[0], IORequest::MAX_LENGTH);
+            return true;
+        }
+
+        bool moveTo(int32_t position)
+        {
+            return io.execute(moveRequest(position)) == IORequest::IO_OK;
+        }
+
+        // Profile selection and goto of a move to position, not submitted yet.
+        IORequestPtr moveRequest(int32_t position)
+        {
+            auto request = std::make_shared<IORequest>();
+            char cmd[IORequest::MAX_LENGTH] = {0};
+
+            // Slew profile from 500 steps on, approach profile below, as the driver
+            int profile = profiles ? ((std::abs(position - current) >= 500) ? 1 : 2) : 0;
+            if (profile != selectedProfile)
+            {
+                snprintf(cmd, sizeof(cmd), ":SL%d#", profile);
+                request->add(cmd, false);
+                selectedProfile = profile;
+            }
+
+            if (version >= 300)
+            {
+                snprintf(cmd, sizeof(cmd), ":FG%09i#", position);
+                request->add(cmd, false);
+            }
+            else
+            {
+                snprintf(cmd, sizeof(cmd), ":SN%09i#", position);
+                request->add(cmd, false);
+                request->add(":FG#", false);
+            }
+
+            current = position;
+            return request;
+        }
+
+        // Poll :GI# until the motion state matches, or use the stream when the firmware has one.
+        bool waitMoving(bool moving, int timeout)
+        {
+            auto deadline = Clock::now() + std::chrono::milliseconds(timeout);
+            while (Clock::now() < deadline)
+            {
+                if (streaming)
+                {
+                    struct pollfd pfd = { io.notifyFD(), POLLIN, 0 };
+                    poll(&pfd, 1, 10);
+                    io.dispatch();
+                    if (events > 0 && streamMoving == moving)
+                        return true;
+                    continue;
+                }
+
+                char res[IORequest::MAX_LENGTH] = {0};
+                ReplyParser::Values values;
+                if (query(":GI#", res) && ReplyParser::parse(":GI#", res, values) &&
+                        (values.get(ReplyParser::FIELD_MOVING) == 1) == moving)
+                    return true;
+            }
+            return false;
+        }
+
+        void setStream(uint32_t interval)
+        {
+            if (!streaming)
+                return;
+            char cmd[IORequest::MAX_LENGTH] = {0};
+            snprintf(cmd, sizeof(cmd), ":SS%05u#", interval);
+            query(cmd);
+        }
+
+        void resetEvents()
+        {
+            io.dispatch();
+            events = 0;
+        }
+
+        IOLoop io;
+        // Use the binary framing and the speed profiles when the firmware has them
+        bool binary { true };
+        bool useProfiles { true };
+        bool profiles { false };
+        int selectedProfile { -1 };
+        // Target of the last move
+        int32_t current { 0 };
+        uint32_t version { 0 };
+        bool streaming { false };
+        uint32_t events { 0 };
+        bool streamMoving { false };
+};
+
+static void report(const char * name, const LatencyHistogram &latency)
+{
+    printf("%-16s %8u %10.3f %10.3f %10.3f\n", name, latency.samples(), latency.percentile(0.5) / 1000.0,
+           latency.percentile(0.99) / 1000.0, latency.maximum() / 1000.0);
+}
+
+struct SoakConfig
+{
+    uint32_t operations { 0 };
+    // Operations per second, 0 submits the next one as soon as fewer than depth are outstanding
+    double rate { 0 };
+    int depth { 8 };
+    // Relative weights of the operations, in the order of SoakStats::Kind
+    int mix[4] = { 40, 30, 10, 20 };
+    int pollInterval { 100 };
+};
+
+/**
+ * @brief The SoakStats struct counts the outcome and latency, from submission to completion,
+ * of each kind of soak operation.
+ */
+struct SoakStats
+{
+    typedef enum { SOAK_ABSOLUTE, SOAK_RELATIVE, SOAK_STOP, SOAK_CONFIG, SOAK_POLL, SOAK_KINDS } Kind;
+
+    struct Entry
+    {
+        uint32_t submitted { 0 };
+        uint32_t ok { 0 };
+        uint32_t cancelled { 0 };
+        uint32_t failed { 0 };
+        // Replies that completed but did not carry the expected value
+        uint32_t mismatched { 0 };
+        LatencyHistogram latency;
+    };
+
+    Entry entries[SOAK_KINDS];
+    uint64_t commands { 0 };
+    uint32_t timeouts { 0 };
+    int outstanding { 0 };
+    int maxOutstanding { 0 };
+};
+
+static const char * const soakNames[SoakStats::SOAK_KINDS] = { "absolute_move", "relative_move", "stop", "config", "poll" };
+
+// Resident and peak resident set of this process in kB, the simulator included
+static void memoryUsage(long &resident, long &peak)
+{
+    resident = peak = 0;
+    FILE * fp = fopen("/proc/self/status", "r");
+    if (fp == nullptr)
+        return;
+
+    char line[128];
+    while (fgets(line, sizeof(line), fp))
+    {
+        sscanf(line, "VmRSS: %ld", &resident);
+        sscanf(line, "VmHWM: %ld", &peak);
+    }
+    fclose(fp);
+}
+
+static void submitSoak(BenchClient &client, SoakStats &stats, SoakStats::Kind kind, const IORequestPtr &request,
+                       std::function<bool(IORequest &)> check)
+{
+    auto start = Clock::now();
+    stats.entries[kind].submitted++;
+    stats.commands += static_cast<uint64_t>(request->count);
+    stats.outstanding++;
+    stats.maxOutstanding = std::max(stats.maxOutstanding, stats.outstanding);
+
+    request->onComplete = [&client, &stats, kind, start, check](IORequest & completed)
+    {
+        SoakStats::Entry &entry = stats.entries[kind];
+        stats.outstanding--;
+
+        if (completed.status == IORequest::IO_OK)
+        {
+            entry.ok++;
+            entry.latency.add(elapsedMicros(start));
+            if (check && !check(completed))
+                entry.mismatched++;
+            return;
+        }
+
+        if (completed.status == IORequest::IO_CANCELLED)
+            entry.cancelled++;
+        else
+            entry.failed++;
+        if (completed.status == IORequest::IO_TIMEOUT)
+            stats.timeouts++;
+        // The profile selection may not have reached the controller
+        if (kind == SoakStats::SOAK_ABSOLUTE || kind == SoakStats::SOAK_RELATIVE)
+            client.selectedProfile = -1;
+    };
+    client.io.submit(request);
+}
+
+static int runSoak(BenchClient &client, const SoakConfig &soak, const SimulatorConfig &config, FILE * out)
+{
+    // Timeouts and retries as the driver sets them after its handshake
+    client.io.setAdaptiveTimeout(true, 50);
+    client.io.setRetries(2);
+    client.setStream(50);
+
+    std::mt19937 random(config.seed);
+    int total = 0;
+    for (int weight : soak.mix)
+        total += std::max(0, weight);
+    if (total == 0)
+    {
+        fprintf(stderr, "The operation mix is empty\n");
+        return 1;
+    }
+    std::uniform_int_distribution<int> pick(1, total);
+    std::uniform_int_distribution<int32_t> absolute(1000, config.maxSteps - 1000);
+    std::uniform_int_distribution<int32_t> relative(-500, 500);
+    std::uniform_int_distribution<int32_t> setting(-50, 50);
+
+    const char * status = (client.version >= 100) ? ":GS#" : ":GP#";
+    SoakStats stats;
+    long residentStart = 0, residentEnd = 0, peak = 0;
+    memoryUsage(residentStart, peak);
+    uint64_t bytes = client.io.bytesIn() + client.io.bytesOut();
+    uint32_t stale = client.io.staleFrames();
+    uint32_t events = client.events;
+
+    auto start = Clock::now();
+    auto nextOperation = start;
+    auto nextPoll = start;
+    auto lastIssue = start;
+    auto interval = std::chrono::microseconds(soak.rate > 0 ? static_cast<int64_t>(1e6 / soak.rate) : 0);
+    const SoakStats::Entry &polls = stats.entries[SoakStats::SOAK_POLL];
+    uint32_t issued = 0;
+
+    while (issued < soak.operations || stats.outstanding > 0)
+    {
+        auto now = Clock::now();
+
+        // The driver polls on its timer and skips a tick while the previous poll is out.
+        bool pollPending = polls.submitted != polls.ok + polls.cancelled + polls.failed;
+        if (issued < soak.operations && !pollPending && now >= nextPoll)
+        {
+            nextPoll = now + std::chrono::milliseconds(soak.pollInterval);
+            auto request = std::make_shared<IORequest>();
+            request->add(status);
+            submitSoak(client, stats, SoakStats::SOAK_POLL, request, [status, &config](IORequest & completed)
+            {
+                ReplyParser::Values values;
+                return ReplyParser::parse(status, completed.res[0], values) &&
+                       values.get(ReplyParser::FIELD_POSITION) >= 0 && values.get(ReplyParser::FIELD_POSITION) <= config.maxSteps;
+            });
+        }
+
+        bool ready = issued < soak.operations && (soak.rate > 0 ? now >= nextOperation : stats.outstanding < soak.depth);
+        if (ready)
+        {
+            nextOperation += interval;
+            lastIssue = now;
+            issued++;
+
+            int choice = pick(random);
+            int kind = 0;
+            while (choice > std::max(0, soak.mix[kind]))
+                choice -= std::max(0, soak.mix[kind++]);
+
+            switch (kind)
+            {
+                case SoakStats::SOAK_ABSOLUTE:
+                    submitSoak(client, stats, SoakStats::SOAK_ABSOLUTE, client.moveRequest(absolute(random)), nullptr);
+                    break;
+
+                case SoakStats::SOAK_RELATIVE:
+                {
+                    int32_t target = std::max(0, std::min(client.current + relative(random), config.maxSteps));
+                    submitSoak(client, stats, SoakStats::SOAK_RELATIVE, client.moveRequest(target), nullptr);
+                    break;
+                }
+
+                case SoakStats::SOAK_STOP:
+                {
+                    auto request = std::make_shared<IORequest>();
+                    request->add(":FQ#", false);
+                    submitSoak(client, stats, SoakStats::SOAK_STOP, request, nullptr);
+                    break;
+                }
+
+                default:
+                {
+                    // A setting written and read back in one request, the reply must hold it.
+                    int32_t value = setting(random);
+                    char cmd[IORequest::MAX_LENGTH] = {0};
+                    snprintf(cmd, sizeof(cmd), ":SC%d#", value);
+                    auto request = std::make_shared<IORequest>();
+                    request->add(cmd, false);
+                    request->add(":GC#");
+                    submitSoak(client, stats, SoakStats::SOAK_CONFIG, request, [value](IORequest & completed)
+                    {
+                        ReplyParser::Values values;
+                        return ReplyParser::parse(":GC#", completed.res[1], values) &&
+                               static_cast<int32_t>(values.get(ReplyParser::FIELD_COEFFICIENT)) == value;
+                    });
+                    break;
+                }
+            }
+        }
+        else
+        {
+            // Sleep until a completion, the next poll or the next operation.
+            auto wake = nextPoll;
+            if (soak.rate > 0 && issued < soak.operations)
+                wake = std::min(wake, nextOperation);
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(wake - now).count();
+            struct pollfd pfd = { client.io.notifyFD(), POLLIN, 0 };
+            poll(&pfd, 1, static_cast<int>(std::max<int64_t>(0, std::min<int64_t>((micros + 999) / 1000, 100))));
+        }
+        client.io.dispatch();
+
+        // Every request ends within its reply timeouts, anything left is lost.
+        if (issued >= soak.operations && Clock::now() - lastIssue > std::chrono::seconds(30))
+        {
+            fprintf(stderr, "%d requests never completed\n", stats.outstanding);
+            return 1;
+        }
+    }
+
+    double duration = std::chrono::duration<double>(Clock::now() - start).count();
+    bytes = client.io.bytesIn() + client.io.bytesOut() - bytes;
+    memoryUsage(residentEnd, peak);
+
+    uint32_t completed = 0, mismatched = 0;
+    for (int kind = 0; kind < SoakStats::SOAK_KINDS; kind++)
+    {
+        completed += stats.entries[kind].ok;
+        mismatched += stats.entries[kind].mismatched;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"config\": {\"firmware\": \"%s\", \"baud\": %u, \"latency_us\": %u, \"jitter_us\": %u, \"framing\": \"%s\", "
+            "\"operations\": %u, \"rate\": %.1f, \"depth\": %d, \"poll_ms\": %d, "
+            "\"mix\": {\"absolute_move\": %d, \"relative_move\": %d, \"stop\": %d, \"config\": %d}},\n",
+            config.version, config.baud, config.latency, config.jitter, client.io.isBinary() ? "binary" : "ascii",
+            soak.operations, soak.rate, soak.depth, soak.pollInterval, soak.mix[0], soak.mix[1], soak.mix[2], soak.mix[3]);
+    fprintf(out, "  \"duration_s\": %.3f,\n", duration);
+    fprintf(out, "  \"throughput\": {\"requests_per_s\": %.1f, \"commands_per_s\": %.1f, \"bytes_per_s\": %.1f, "
+            "\"max_outstanding\": %d},\n", completed / duration, stats.commands / duration, bytes / duration,
+            stats.maxOutstanding);
+    fprintf(out, "  \"operations\": {\n");
+    for (int kind = 0; kind < SoakStats::SOAK_KINDS; kind++)
+    {
+        const SoakStats::Entry &entry = stats.entries[kind];
+        fprintf(out, "    \"%s\": {\"submitted\": %u, \"ok\": %u, \"cancelled\": %u, \"failed\": %u, \"mismatched\": %u, "
+                "\"p50_us\": %u, \"p99_us\": %u, \"p999_us\": %u, \"max_us\": %u}%s\n", soakNames[kind], entry.submitted,
+                entry.ok, entry.cancelled, entry.failed, entry.mismatched, entry.latency.percentile(0.5),
+                entry.latency.percentile(0.99), entry.latency.percentile(0.999), entry.latency.maximum(),
+                kind + 1 < SoakStats::SOAK_KINDS ? "," : "");
+    }
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"replies\": {\"timeouts\": %u, \"stale\": %u, \"mismatched\": %u, \"retried\": %u, \"preempted\": %u, "
+            "\"crc_errors\": %u, \"events\": %u, \"dropped_events\": %u},\n", stats.timeouts,
+            client.io.staleFrames() - stale, mismatched, client.io.retriedCommands(), client.io.preemptedRequests(),
+            client.io.crcErrors(), client.events - events, client.io.droppedEvents());
+    fprintf(out, "  \"memory\": {\"rss_start_kb\": %ld, \"rss_end_kb\": %ld, \"rss_peak_kb\": %ld, \"growth_kb\": %ld}\n",
+            residentStart, residentEnd, peak, residentEnd - residentStart);
+    fprintf(out, "}\n");
+
+    // A read-back that does not match is a reply taken for another request's, stops and
+    // retries included. Never tolerated.
+    if (mismatched > 0)
+    {
+        fprintf(stderr, "%u replies did not match their request\n", mismatched);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char * argv[])
+{
+    SimulatorConfig config;
+    int runs = 20;
+    bool ascii = false;
+    bool constant = false;
+    SoakConfig soak;
+    const char * output = nullptr;
+
+    int option = 0;
+    while ((option = getopt(argc, argv, "b:l:j:v:n:acs:r:q:m:p:o:")) != -1)
+    {
+        switch (option)
+        {
+            case 'b':
+                config.baud = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'l':
+                config.latency = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'j':
+                config.jitter = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'v':
+                config.version = optarg;
+                break;
+            case 'n':
+                runs = std::max(1, atoi(optarg));
+                break;
+            case 'a':
+                ascii = true;
+                break;
+            case 'c':
+                constant = true;
+                break;
+            case 's':
+                soak.operations = static_cast<uint32_t>(std::max(0, atoi(optarg)));
+                break;
+            case 'r':
+                soak.rate = std::max(0.0, atof(optarg));
+                break;
+            case 'q':
+                soak.depth = std::max(1, atoi(optarg));
+                break;
+            case 'm':
+                if (sscanf(optarg, "%d,%d,%d,%d", &soak.mix[0], &soak.mix[1], &soak.mix[2], &soak.mix[3]) != 4)
+                {
+                    fprintf(stderr, "-m takes four weights: abs,rel,stop,config\n");
+                    return 1;
+                }
+                break;
+            case 'p':
+                soak.pollInterval = std::max(1, atoi(optarg));
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-b baud] [-l latency_us] [-j jitter_us] [-v version] [-n runs] [-a] [-c]\n"
+                        "       [-s operations [-r rate] [-q depth] [-m abs,rel,stop,config] [-p poll_ms] [-o file]]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    ControllerSimulator simulator(config);
+    if (!simulator.start())
+    {
+        perror("Failed to create the pseudo terminal");
+        return 1;
+    }
+
+    int fd = simulator.openClient();
+    BenchClient client;
+    client.binary = !ascii;
+    client.useProfiles = !constant;
+    if (fd < 0 || !client.open(fd))
+    {
+        perror("Failed to open the simulated port");
+        return 1;
+    }
+    client.io.setTimeout(3000);
+
+    if (soak.operations > 0)
+    {
+        if (!client.connect())
+        {
+            fprintf(stderr, "Connect failed\n");
+            return 1;
+        }
+
+        FILE * out = output ? fopen(output, "w") : stdout;
+        if (out == nullptr)
+        {
+            perror("Failed to open the output file");
+            return 1;
+        }
+        int rc = runSoak(client, soak, config, out);
+        if (out != stdout)
+            fclose(out);
+
+        client.close();
+        close(fd);
+        simulator.stop();
+        return rc;
+    }
+
+    LatencyHistogram connectTime, moveStart, poll, autofocus, slew;
+
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = Clock::now();
+        if (!client.connect())
+        {
+            fprintf(stderr, "Connect failed\n");
+            return 1;
+        }
+        connectTime.add(elapsedMicros(start));
+    }
+
+    client.setStream(50);
+
+    int32_t position = 1000;
+    client.current = 1000;
+    if (!client.query(":SP1000#"))
+    {
+        fprintf(stderr, "Sync failed\n");
+        return 1;
+    }
+    for (int i = 0; i < runs; i++)
+    {
+        client.resetEvents();
+        position += (i % 2) ? -200 : 200;
+
+        auto start = Clock::now();
+        if (!client.moveTo(position) || !client.waitMoving(true, 3000))
+        {
+            fprintf(stderr, "Move did not start\n");
+            return 1;
+        }
+        moveStart.add(elapsedMicros(start));
+        client.waitMoving(false, 5000);
+    }
+
+    const char * status = (client.version >= 100) ? ":GS#" : ":GP#";
+    uint64_t pollBytes = client.io.bytesIn() + client.io.bytesOut();
+    auto pollStart = Clock::now();
+    for (int i = 0; i < runs * 10; i++)
+    {
+        auto start = Clock::now();
+        char res[IORequest::MAX_LENGTH] = {0};
+        if (!client.query(status, res))
+        {
+            fprintf(stderr, "Poll failed\n");
+            return 1;
+        }
+        poll.add(elapsedMicros(start));
+    }
+    double pollRate = runs * 10 / std::chrono::duration<double>(Clock::now() - pollStart).count();
+    pollBytes = client.io.bytesIn() + client.io.bytesOut() - pollBytes;
+
+    // Autofocus: ten small outward steps, each waited for and measured.
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = Clock::now();
+        for (int step = 0; step < 10; step++)
+        {
+            client.resetEvents();
+            position += 20;
+            char res[IORequest::MAX_LENGTH] = {0};
+            if (!client.moveTo(position) || !client.waitMoving(true, 3000) || !client.waitMoving(false, 5000) ||
+                    !client.query(status, res))
+            {
+                fprintf(stderr, "Autofocus step failed\n");
+                return 1;
+            }
+        }
+        autofocus.add(elapsedMicros(start));
+    }
+
+    // Long slews back and forth, a few seconds each
+    for (int i = 0; i < std::min(runs, 3); i++)
+    {
+        client.resetEvents();
+        position += (i % 2) ? -4000 : 4000;
+
+        auto start = Clock::now();
+        if (!client.moveTo(position) || !client.waitMoving(true, 3000) || !client.waitMoving(false, 20000))
+        {
+            fprintf(stderr, "Slew failed\n");
+            return 1;
+        }
+        slew.add(elapsedMicros(start));
+    }
+
+    printf("Simulated firmware %s, %u baud, %u us latency, %u us jitter, %s framing, %s\n", config.version, config.baud,
+           config.latency, config.jitter, client.io.isBinary() ? "binary" : "ASCII",
+           client.profiles ? "speed profiles" : "constant speed");
+    printf("%-16s %8s %10s %10s %10s\n", "scenario", "samples", "p50 (ms)", "p99 (ms)", "max (ms)");
+    report("connect", connectTime);
+    report("move start", moveStart);
+    report("status poll", poll);
+    report("autofocus x10", autofocus);
+    report("slew 4000", slew);
+    printf("Status poll throughput: %.1f/s, %.1f bytes each\n", pollRate, static_cast<double>(pollBytes) / (runs * 10));
+
+    client.close();
+    close(fd);
+    simulator.stop();
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_binary.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const uint8_t BinaryProtocol::SYNC;
+const uint8_t BinaryProtocol::REPLY_FLAG;
+const size_t BinaryProtocol::MAX_PAYLOAD;
+const size_t BinaryProtocol::OVERHEAD;
+const size_t BinaryProtocol::MAX_FRAME;
+
+namespace
+{
+
+typedef enum { ARG_NONE, ARG_OPTIONAL, ARG_INT32, ARG_SIGNED } Argument;
+
+/**
+ * Reply and event layouts, one letter per field:
+ * l int32, b uint8, t int16 hundredths (temperature), separated by sep in ASCII.
+ */
+struct Opcode
+{
+    uint8_t opcode;
+    const char * code;
+    Argument argument;
+    const char * layout;
+    char sep;
+};
+
+const Opcode opcodes[] =
+{
+    // Queries
+    { 0x01, "GV", ARG_NONE, "bbb", '.' },
+    { 0x02, "GP", ARG_NONE, "l", ',' },
+    { 0x03, "GI", ARG_NONE, "b", ',' },
+    { 0x04, "GT", ARG_NONE, "t", ',' },
+    { 0x05, "GD", ARG_NONE, "l", ',' },
+    { 0x06, "GE", ARG_NONE, "b", ',' },
+    { 0x07, "GR", ARG_NONE, "b", ',' },
+    { 0x08, "GO", ARG_NONE, "l", ',' },
+    { 0x09, "GC", ARG_NONE, "l", ',' },
+    { 0x0A, "GS", ARG_NONE, "lbtb", ',' },
+    { 0x0B, "GH", ARG_NONE, "l", ',' },
+    // Commands without a reply. :FT# takes a signed duration, negative moves inward.
+    { 0x20, "SN", ARG_INT32, nullptr, 0 },
+    { 0x21, "FG", ARG_OPTIONAL, nullptr, 0 },
+    { 0x22, "FT", ARG_SIGNED, nullptr, 0 },
+    { 0x23, "FQ", ARG_NONE, nullptr, 0 },
+    { 0x24, "SP", ARG_INT32, nullptr, 0 },
+    { 0x25, "SD", ARG_INT32, nullptr, 0 },
+    { 0x26, "SM", ARG_INT32, nullptr, 0 },
+    { 0x27, "SE", ARG_INT32, nullptr, 0 },
+    { 0x28, "SR", ARG_INT32, nullptr, 0 },
+    { 0x29, "SO", ARG_INT32, nullptr, 0 },
+    { 0x2A, "SC", ARG_INT32, nullptr, 0 },
+    { 0x2B, "SS", ARG_INT32, nullptr, 0 },
+    { 0x2C, "SF", ARG_INT32, nullptr, 0 },
+    { 0x2D, "HO", ARG_NONE, nullptr, 0 },
+    { 0x2E, "+", ARG_NONE, nullptr, 0 },
+    { 0x2F, "-", ARG_NONE, nullptr, 0 },
+    { 0x30, "SL", ARG_INT32, nullptr, 0 },
+};
+
+// Events, the letter after '!' in ASCII
+const Opcode eventOpcodes[] =
+{
+    { 0x80, "P", ARG_NONE, "lb", ',' },
+    { 0x81, "D", ARG_NONE, "l", ',' },
+};
+
+size_t fieldSize(char type)
+{
+    return (type == 'l') ? 4 : (type == 't') ? 2 : 1;
+}
+
+const Opcode * findCode(const char * command)
+{
+    if (command == nullptr || command[0] != ':')
+        return nullptr;
+
+    for (const auto &entry : opcodes)
+    {
+        size_t len = strlen(entry.code);
+        if (strncmp(command + 1, entry.code, len) == 0)
+            return &entry;
+    }
+    return nullptr;
+}
+
+const Opcode * findOpcode(uint8_t opcode)
+{
+    if (opcode & 0x80)
+    {
+        for (const auto &entry : eventOpcodes)
+            if (entry.opcode == opcode)
+                return &entry;
+        return nullptr;
+    }
+
+    uint8_t base = opcode & static_cast<uint8_t>(~BinaryProtocol::REPLY_FLAG);
+    for (const auto &entry : opcodes)
+    {
+        if (entry.opcode == base)
+        {
+            // Only queries have replies.
+            if ((opcode & BinaryProtocol::REPLY_FLAG) && entry.layout == nullptr)
+                return nullptr;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void putLE(uint8_t * p, int32_t value, size_t size)
+{
+    uint32_t bits = static_cast<uint32_t>(value);
+    for (size_t i = 0; i < size; i++)
+        p[i] = static_cast<uint8_t>(bits >> (8 * i));
+}
+
+int32_t getLE(const uint8_t * p, size_t size)
+{
+    uint32_t bits = 0;
+    for (size_t i = 0; i < size; i++)
+        bits |= static_cast<uint32_t>(p[i]) << (8 * i);
+
+    // Sign extend the narrower fields.
+    if (size < 4 && (bits & (1u << (8 * size - 1))))
+        bits |= ~0u << (8 * size);
+    return static_cast<int32_t>(bits);
+}
+
+size_t frame(const uint8_t * payload, size_t len, uint8_t * out, size_t maxlen)
+{
+    if (len == 0 || len > BinaryProtocol::MAX_PAYLOAD || len + BinaryProtocol::OVERHEAD > maxlen)
+        return 0;
+
+    out[0] = BinaryProtocol::SYNC;
+    out[1] = static_cast<uint8_t>(len);
+    memcpy(out + 2, payload, len);
+    uint16_t crc = BinaryProtocol::crc16(out + 1, len + 1);
+    out[len + 2] = static_cast<uint8_t>(crc);
+    out[len + 3] = static_cast<uint8_t>(crc >> 8);
+    return len + BinaryProtocol::OVERHEAD;
+}
+
+}
+
+uint16_t BinaryProtocol::crc16(const uint8_t * data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    }
+    return crc;
+}
+
+size_t BinaryProtocol::encodeCommand(const char * command, uint8_t * out, size_t maxlen)
+{
+    const Opcode * entry = findCode(command);
+    if (entry == nullptr)
+        return 0;
+
+    uint8_t payload[MAX_PAYLOAD];
+    size_t len = 0;
+    payload[len++] = entry->opcode;
+
+    const char * argument = command + 1 + strlen(entry->code);
+    bool hasArgument = *argument != '#' && *argument != '\0';
+
+    switch (entry->argument)
+    {
+        case ARG_NONE:
+            break;
+        case ARG_OPTIONAL:
+        case ARG_INT32:
+            if (!hasArgument)
+            {
+                if (entry->argument == ARG_INT32)
+                    return 0;
+                break;
+            }
+            putLE(payload + len, static_cast<int32_t>(strtol(argument, nullptr, 10)), 4);
+            len += 4;
+            break;
+        case ARG_SIGNED:
+        {
+            if (*argument != '+' && *argument != '-')
+                return 0;
+            int32_t value = static_cast<int32_t>(strtol(argument + 1, nullptr, 10));
+            putLE(payload + len, (*argument == '-') ? -value : value, 4);
+            len += 4;
+            break;
+        }
+    }
+
+    return frame(payload, len, out, maxlen);
+}
+
+size_t BinaryProtocol::encodeReply(const char * command, const char * reply, uint8_t * out, size_t maxlen)
+{
+    const Opcode * entry = nullptr;
+    const char * p = reply;
+    uint8_t opcode = 0;
+
+    if (reply != nullptr && reply[0] == '!')
+    {
+        for (const auto &event : eventOpcodes)
+        {
+            if (reply[1] == event.code[0])
+                entry = &event;
+        }
+        if (entry == nullptr)
+            return 0;
+        opcode = entry->opcode;
+        p = reply + 2;
+    }
+    else
+    {
+        entry = findCode(command);
+        if (entry == nullptr || entry->layout == nullptr || reply == nullptr)
+            return 0;
+        opcode = entry->opcode | REPLY_FLAG;
+    }
+
+    uint8_t payload[MAX_PAYLOAD];
+    size_t len = 0;
+    payload[len++] = opcode;
+
+    for (const char * type = entry->layout; *type; type++)
+    {
+        // Only the temperature has decimals, and a version has dots for separators.
+        char * end = nullptr;
+        int32_t field = 0;
+        if (*type == 't')
+        {
+            double value = strtod(p, &end);
+            field = static_cast<int32_t>(value * 100 + (value < 0 ? -0.5 : 0.5));
+        }
+        else
+            field = static_cast<int32_t>(strtol(p, &end, 10));
+        if (end == p)
+            return 0;
+        p = end;
+        if (*p == entry->sep || *p == '#')
+            p++;
+
+        putLE(payload + len, field, fieldSize(*type));
+        len += fieldSize(*type);
+    }
+
+    return frame(payload, len, out, maxlen);
+}
+
+BinaryProtocol::Result BinaryProtocol::extract(FrameBuffer &buffer, char * text, size_t maxlen)
+{
+    // Resynchronize on the next sync byte.
+    while (buffer.available() > 0 && buffer.peek(0) != SYNC)
+        buffer.discard(1);
+
+    if (buffer.available() < 2)
+        return FRAME_NONE;
+
+    size_t len = buffer.peek(1);
+    if (len == 0 || len > MAX_PAYLOAD)
+    {
+        buffer.discard(1);
+        return FRAME_BAD;
+    }
+    if (buffer.available() < len + OVERHEAD)
+        return FRAME_NONE;
+
+    uint8_t bytes[MAX_FRAME];
+    for (size_t i = 0; i < len + OVERHEAD; i++)
+        bytes[i] = buffer.peek(i);
+
+    uint16_t crc = static_cast<uint16_t>(bytes[len + 2] | (bytes[len + 3] << 8));
+    const Opcode * entry = findOpcode(bytes[2]);
+    if (crc != crc16(bytes + 1, len + 1) || entry == nullptr)
+    {
+        // A sync byte inside corrupted data, look for the next one.
+        buffer.discard(1);
+        return FRAME_BAD;
+    }
+
+    char rendered[64];
+    const uint8_t * field = bytes + 3;
+    const uint8_t * end = bytes + 2 + len;
+    int pos = 0;
+    uint8_t opcode = bytes[2];
+
+    if (opcode & 0x80)
+        pos = snprintf(rendered, sizeof(rendered), "!%s", entry->code);
+
+    if ((opcode & 0x80) || (opcode & REPLY_FLAG))
+    {
+        for (const char * type = entry->layout; *type; type++)
+        {
+            size_t size = fieldSize(*type);
+            if (field + size > end)
+            {
+                buffer.discard(1);
+                return FRAME_BAD;
+            }
+            int32_t value = getLE(field, size);
+            field += size;
+
+            const char * sep = (type == entry->layout) ? "" : (entry->sep == '.') ? "." : ",";
+            if (*type == 't')
+                pos += snprintf(rendered + pos, sizeof(rendered) - pos, "%s%s%d.%02d", sep, value < 0 ? "-" : "", abs(value) / 100,
+                                abs(value) % 100);
+            else
+                pos += snprintf(rendered + pos, sizeof(rendered) - pos, "%s%d", sep, (*type == 'b') ? value & 0xFF : value);
+        }
+    }
+    else
+    {
+        pos = snprintf(rendered, sizeof(rendered), ":%s", entry->code);
+        if (field + 4 <= end)
+        {
+            int32_t value = getLE(field, 4);
+            if (entry->argument == ARG_SIGNED)
+                pos += snprintf(rendered + pos, sizeof(rendered) - pos, "%c%d", value < 0 ? '-' : '+', abs(value));
+            else
+                pos += snprintf(rendered + pos, sizeof(rendered) - pos, "%d", value);
+        }
+    }
+    snprintf(rendered + pos, sizeof(rendered) - pos, "#");
+
+    char discard[MAX_FRAME];
+    buffer.read(discard, len + OVERHEAD);
+
+    if (strlen(rendered) >= maxlen)
+        return FRAME_BAD;
+    strcpy(text, rendered);
+    return FRAME_OK;
+}
@@ -0,0 +1,75 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+#pragma once
+
+#include "astrostep_framebuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The BinaryProtocol class encodes the compact framing negotiated with firmware 0.7.0.
+ *
+ * A frame is SYNC, the payload length, the payload and a CRC-16/CCITT of the length and
+ * payload, low byte first. The payload is an opcode followed by fixed width little endian
+ * fields. Each ASCII command has an opcode, replies carry the opcode of their query with
+ * REPLY_FLAG set, and events have opcodes of their own.
+ *
+ * Decoded frames are rendered as their ASCII equivalent (":SN1234#", "1234#", "!P12,1#"),
+ * so request matching, ReplyParser, logging and traces work the same in both modes. The
+ * controller answers each command in the framing it arrived in.
+ */
+class BinaryProtocol
+{
+    public:
+        static const uint8_t SYNC { 0xA5 };
+        static const uint8_t REPLY_FLAG { 0x40 };
+        static const size_t MAX_PAYLOAD { 16 };
+        // Sync, length and CRC
+        static const size_t OVERHEAD { 4 };
+        static const size_t MAX_FRAME { MAX_PAYLOAD + OVERHEAD };
+
+        typedef enum { FRAME_NONE, FRAME_OK, FRAME_BAD } Result;
+
+        /**
+         * @brief encodeCommand Binary frame of an ASCII command, e.g. ":SN000001234#".
+         * @return Frame length, 0 if the command has no binary form.
+         */
+        static size_t encodeCommand(const char * command, uint8_t * frame, size_t maxlen);
+
+        /**
+         * @brief encodeReply Binary frame of the ASCII reply to command, or of an event frame
+         * (command is then ignored). Used by the controller side.
+         * @return Frame length, 0 if the reply does not fit the layout of the query.
+         */
+        static size_t encodeReply(const char * command, const char * reply, uint8_t * frame, size_t maxlen);
+
+        /**
+         * @brief extract Take the next frame out of buffer and render it as ASCII.
+         * Bytes before a sync byte are discarded.
+         * @return FRAME_NONE if no complete frame is buffered, FRAME_BAD if one failed its CRC
+         * or is unknown (its sync byte is dropped and the search restarts after it).
+         */
+        static Result extract(FrameBuffer &buffer, char * text, size_t maxlen);
+
+        static uint16_t crc16(const uint8_t * data, size_t len);
+};
@@ -0,0 +1,97 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief The CommandFormat struct describes a setter of the form ":<code>[sign]<digits>#".
+ *
+ * Formats are constant expressions and encode() is constexpr, so a command with a constant
+ * argument is a literal built by the compiler, and any other is written digit by digit
+ * without parsing a format string at run time.
+ */
+struct CommandFormat
+{
+    static const int MAX_LENGTH { 32 };
+
+    // Encoded command, NUL terminated
+    struct Text
+    {
+        char text[MAX_LENGTH];
+        int length;
+    };
+
+    char code[3];
+    // Digits are zero padded to this width, a minus sign included, as with "%09d"
+    int width;
+    // A '+' is written before positive values, as with "%+d"
+    bool sign;
+
+    constexpr Text encode(int64_t value) const
+    {
+        Text result {{0}, 0};
+        char digits[20] = {0};
+        int count = 0;
+        bool negative = value < 0;
+        uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        do
+        {
+            digits[count++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        }
+        while (magnitude > 0);
+
+        result.text[result.length++] = ':';
+        for (int i = 0; code[i] != '\0'; i++)
+            result.text[result.length++] = code[i];
+        if (negative)
+            result.text[result.length++] = '-';
+        else if (sign)
+            result.text[result.length++] = '+';
+        for (int i = (negative || sign) ? count + 1 : count; i < width; i++)
+            result.text[result.length++] = '0';
+        while (count > 0)
+            result.text[result.length++] = digits[--count];
+        result.text[result.length++] = '#';
+        return result;
+    }
+};
+
+// Setters of the ASCII protocol, with the padding the firmware parses
+namespace Command
+{
+constexpr CommandFormat SYNC { "SP", 9, false };
+constexpr CommandFormat TARGET { "SN", 9, false };
+constexpr CommandFormat GOTO { "FG", 9, false };
+constexpr CommandFormat TIMED { "FT", 6, true };
+constexpr CommandFormat SPEED { "SD", 0, false };
+constexpr CommandFormat PROFILE { "SL", 0, false };
+constexpr CommandFormat COIL_POWER { "SE", 0, false };
+constexpr CommandFormat REVERSE { "SR", 0, false };
+constexpr CommandFormat CALIBRATION { "SO", 0, false };
+constexpr CommandFormat COEFFICIENT { "SC", 0, false };
+constexpr CommandFormat STREAM { "SS", 5, false };
+constexpr CommandFormat DONE_EVENTS { "SF", 0, false };
+
+// Constant commands, encoded by the compiler
+constexpr CommandFormat::Text ENABLE_DONE_EVENTS = DONE_EVENTS.encode(1);
+}
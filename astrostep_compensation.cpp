@@ -0,0 +1,191 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_compensation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <gsl/gsl_multifit.h>
+
+const int TemperatureModel::MAX_FILTERS;
+const int TemperatureModel::MAX_POINTS;
+const int TemperatureModel::MAX_ORDER;
+constexpr double TemperatureModel::TABLE_MIN;
+constexpr double TemperatureModel::TABLE_STEP;
+const int TemperatureModel::TABLE_SIZE;
+
+// Points must span at least this many degrees to fit a model
+static const double MIN_SPREAD { 1.0 };
+
+bool TemperatureModel::addPoint(int filter, double temperature, double position)
+{
+    if (!valid(filter))
+        return false;
+
+    Filter &f = filters[filter];
+    f.temperature[f.next] = temperature;
+    f.position[f.next] = position;
+    f.next = (f.next + 1) % MAX_POINTS;
+    f.count = std::min(f.count + 1, static_cast<int>(MAX_POINTS));
+    return true;
+}
+
+void TemperatureModel::clear(int filter)
+{
+    if (valid(filter))
+        filters[filter] = Filter();
+}
+
+int TemperatureModel::points(int filter) const
+{
+    return valid(filter) ? filters[filter].count : 0;
+}
+
+bool TemperatureModel::hasModel(int filter) const
+{
+    return valid(filter) && filters[filter].fitted;
+}
+
+const double * TemperatureModel::coefficients(int filter) const
+{
+    return valid(filter) ? filters[filter].coefficients : nullptr;
+}
+
+bool TemperatureModel::fit(int filter, int order)
+{
+    if (!valid(filter))
+        return false;
+
+    Filter &f = filters[filter];
+    f.fitted = false;
+
+    order = std::max(1, std::min(order, static_cast<int>(MAX_ORDER)));
+    if (f.count < order + 1)
+        return false;
+
+    double low = *std::min_element(f.temperature, f.temperature + f.count);
+    double high = *std::max_element(f.temperature, f.temperature + f.count);
+    if (high - low < MIN_SPREAD)
+        return false;
+
+    const size_t terms = static_cast<size_t>(order + 1);
+    gsl_matrix * X = gsl_matrix_alloc(f.count, terms);
+    gsl_vector * y = gsl_vector_alloc(f.count);
+    gsl_vector * c = gsl_vector_alloc(terms);
+    gsl_matrix * cov = gsl_matrix_alloc(terms, terms);
+    gsl_multifit_linear_workspace * work = gsl_multifit_linear_alloc(f.count, terms);
+
+    for (int i = 0; i < f.count; i++)
+    {
+        double term = 1;
+        for (size_t j = 0; j < terms; j++)
+        {
+            gsl_matrix_set(X, i, j, term);
+            term *= f.temperature[i];
+        }
+        gsl_vector_set(y, i, f.position[i]);
+    }
+
+    double chisq = 0;
+    bool success = gsl_multifit_linear(X, y, c, cov, &chisq, work) == 0;
+
+    if (success)
+    {
+        std::fill(f.coefficients, f.coefficients + MAX_ORDER + 1, 0.0);
+        for (size_t j = 0; j < terms; j++)
+            f.coefficients[j] = gsl_vector_get(c, j);
+
+        for (int i = 0; i < TABLE_SIZE; i++)
+        {
+            double t = TABLE_MIN + i * TABLE_STEP;
+            double value = f.coefficients[0] + f.coefficients[1] * t + f.coefficients[2] * t * t;
+            f.table[i] = static_cast<int32_t>(std::lround(value));
+        }
+        f.fitted = true;
+    }
+
+    gsl_multifit_linear_free(work);
+    gsl_matrix_free(cov);
+    gsl_vector_free(c);
+    gsl_vector_free(y);
+    gsl_matrix_free(X);
+
+    return success;
+}
+
+double TemperatureModel::offset(int filter, double temperature) const
+{
+    if (!hasModel(filter))
+        return 0;
+
+    const Filter &f = filters[filter];
+
+    double index = (temperature - TABLE_MIN) / TABLE_STEP;
+    index = std::max(0.0, std::min(index, static_cast<double>(TABLE_SIZE - 1)));
+
+    int low = static_cast<int>(index);
+    int high = std::min(low + 1, TABLE_SIZE - 1);
+    double fraction = index - low;
+
+    return f.table[low] + (f.table[high] - f.table[low]) * fraction;
+}
+
+bool TemperatureModel::load(const char * path)
+{
+    FILE * fp = fopen(path, "r");
+    if (fp == nullptr)
+        return false;
+
+    for (auto &f : filters)
+        f = Filter();
+
+    // One point per line: filter temperature position
+    int filter = 0;
+    double temperature = 0, position = 0;
+    while (fscanf(fp, "%d %lf %lf", &filter, &temperature, &position) == 3)
+        addPoint(filter, temperature, position);
+
+    fclose(fp);
+    return true;
+}
+
+bool TemperatureModel::save(const char * path) const
+{
+    FILE * fp = fopen(path, "w");
+    if (fp == nullptr)
+        return false;
+
+    for (int filter = 0; filter < MAX_FILTERS; filter++)
+    {
+        const Filter &f = filters[filter];
+        // Oldest point first, so reloading keeps the same order
+        int first = (f.count < MAX_POINTS) ? 0 : f.next;
+        for (int i = 0; i < f.count; i++)
+        {
+            int index = (first + i) % MAX_POINTS;
+            fprintf(fp, "%d %.3f %.0f\n", filter, f.temperature[index], f.position[index]);
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,94 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief The TemperatureModel class fits a temperature to focus position curve per filter.
+ *
+ * Each point is the best focus position found by a focus run at a given temperature.
+ * A least squares polynomial is fitted over the points of a filter and tabulated every
+ * TABLE_STEP degrees, so evaluating an offset is a table lookup and a linear interpolation.
+ */
+class TemperatureModel
+{
+    public:
+        static const int MAX_FILTERS { 8 };
+        static const int MAX_POINTS { 64 };
+        static const int MAX_ORDER { 2 };
+
+        // Tabulated temperature range in Celsius
+        static constexpr double TABLE_MIN { -30 };
+        static constexpr double TABLE_STEP { 0.5 };
+        static const int TABLE_SIZE { 141 };
+
+        /**
+         * @brief addPoint Record a focus run. The oldest point is dropped when the filter is full.
+         * @return False if filter is out of range.
+         */
+        bool addPoint(int filter, double temperature, double position);
+
+        void clear(int filter);
+
+        int points(int filter) const;
+
+        /**
+         * @brief fit Fit a polynomial of the given order over the points of filter and tabulate it.
+         * @return False if there are not enough points or they do not span enough temperature.
+         */
+        bool fit(int filter, int order);
+
+        bool hasModel(int filter) const;
+
+        /**
+         * @brief offset Focus position predicted by the model of filter at temperature.
+         * Temperatures outside the table are clamped to its range.
+         */
+        double offset(int filter, double temperature) const;
+
+        // Fitted polynomial coefficients, constant term first.
+        const double * coefficients(int filter) const;
+
+        bool load(const char * path);
+        bool save(const char * path) const;
+
+    private:
+        struct Filter
+        {
+            double temperature[MAX_POINTS] = {0};
+            double position[MAX_POINTS] = {0};
+            int count { 0 };
+            // Next slot to overwrite once the filter is full
+            int next { 0 };
+
+            bool fitted { false };
+            double coefficients[MAX_ORDER + 1] = {0};
+            int32_t table[TABLE_SIZE] = {0};
+        };
+
+        bool valid(int filter) const
+        {
+            return filter >= 0 && filter < MAX_FILTERS;
+        }
+
+        Filter filters[MAX_FILTERS];
+};
@@ -0,0 +1,104 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+    Export the telemetry ring file of the driver.
+
+    Prints the samples as CSV, oldest first, optionally restricted to a time range in seconds
+    since the epoch. With -p it prints instead the position each move settled at, as focus
+    runs in the format of the driver's temperature file, so the compensation can be fitted
+    again from the history.
+
+    Usage: astrostep_export [-f from] [-t to] [-p] file
+*/
+
+#include "astrostep_telemetry.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+int main(int argc, char * argv[])
+{
+    double from = 0, to = 0;
+    bool points = false;
+
+    int option = 0;
+    while ((option = getopt(argc, argv, "f:t:p")) != -1)
+    {
+        switch (option)
+        {
+            case 'f':
+                from = atof(optarg);
+                break;
+            case 't':
+                to = atof(optarg);
+                break;
+            case 'p':
+                points = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-f from] [-t to] [-p] file\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-f from] [-t to] [-p] file\n", argv[0]);
+        return 1;
+    }
+
+    TelemetryLog log;
+    if (!log.open(argv[optind]))
+    {
+        fprintf(stderr, "%s is not a telemetry file\n", argv[optind]);
+        return 1;
+    }
+
+    if (!points)
+        printf("time,position,target,temperature,moving,filter,latency_us\n");
+
+    bool wasMoving = false;
+    uint64_t end = log.written();
+    for (uint64_t sequence = log.oldest(); sequence < end; sequence++)
+    {
+        TelemetryLog::Sample sample;
+        // Overwritten by the driver while exporting
+        if (!log.get(sequence, sample))
+            continue;
+
+        double time = sample.time / 1e6;
+        if (time < from || (to > 0 && time > to))
+            continue;
+
+        if (!points)
+            printf("%.6f,%d,%d,%.2f,%u,%u,%u\n", time, sample.position, sample.target, sample.temperature, sample.moving,
+                   sample.filter + 1, sample.latency);
+        // First sample at rest after a move
+        else if (wasMoving && !sample.moving)
+            printf("%u %.3f %d\n", sample.filter, sample.temperature, sample.position);
+
+        wasMoving = sample.moving;
+    }
+
+    return 0;
+}
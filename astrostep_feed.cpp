@@ -0,0 +1,196 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_feed.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t PositionFeed::VERSION;
+const int PositionFeed::MAX_NAME;
+const int PositionFeed::MAX_ATTEMPTS;
+
+static const char FEED_MAGIC[8] = { 'A', 'S', 'F', 'E', 'E', 'D', 0, 0 };
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "Shared atomics must be lock free");
+
+PositionFeed::~PositionFeed()
+{
+    close();
+}
+
+void PositionFeed::segmentName(const char * device, char * name, size_t len)
+{
+    int written = snprintf(name, len, "/astrostep_%s", device);
+    size_t end = (written < 0) ? 0 : std::min(static_cast<size_t>(written), len - 1);
+    for (size_t i = strlen("/astrostep_"); i < end; i++)
+    {
+        if (!isalnum(static_cast<unsigned char>(name[i])))
+            name[i] = '_';
+    }
+}
+
+bool PositionFeed::create(const char * name)
+{
+    close();
+
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+
+    // A segment left by a previous session is reused, its readers keep their mapping.
+    struct stat st;
+    bool reuse = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == sizeof(Segment);
+    if (!reuse && ftruncate(fd, sizeof(Segment)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void * base = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    segment = static_cast<Segment *>(base);
+    writer = true;
+    strncpy(segmentPath, name, MAX_NAME - 1);
+
+    if (!reuse || memcmp(segment->magic, FEED_MAGIC, sizeof(FEED_MAGIC)) != 0 || segment->version != VERSION)
+    {
+        memset(base, 0, sizeof(Segment));
+        memcpy(segment->magic, FEED_MAGIC, sizeof(FEED_MAGIC));
+        segment->version = VERSION;
+    }
+    // An odd sequence left by a writer that died mid update would stall the readers.
+    segment->sequence.store(segment->sequence.load(std::memory_order_relaxed) & ~1u, std::memory_order_release);
+    return true;
+}
+
+bool PositionFeed::open(const char * name)
+{
+    close();
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool valid = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == sizeof(Segment);
+    void * base = valid ? mmap(nullptr, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    segment = static_cast<Segment *>(base);
+    if (memcmp(segment->magic, FEED_MAGIC, sizeof(FEED_MAGIC)) != 0 || segment->version != VERSION)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void PositionFeed::close()
+{
+    if (segment == nullptr)
+        return;
+
+    if (writer)
+    {
+        State last;
+        if (read(last))
+        {
+            last.online = 0;
+            last.time = 0;
+            publish(last);
+        }
+        shm_unlink(segmentPath);
+    }
+
+    munmap(segment, sizeof(Segment));
+    segment = nullptr;
+    writer = false;
+    segmentPath[0] = '\0';
+}
+
+void PositionFeed::publish(State state)
+{
+    if (segment == nullptr || !writer)
+        return;
+
+    if (state.time == 0)
+        state.time = std::chrono::duration_cast<std::chrono::microseconds>
+                     (std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // The odd sequence must be visible before any field changes.
+    uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+    segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    segment->time.store(state.time, std::memory_order_relaxed);
+    segment->position.store(state.position, std::memory_order_relaxed);
+    segment->target.store(state.target, std::memory_order_relaxed);
+    segment->temperature.store(state.temperature, std::memory_order_relaxed);
+    segment->moving.store(state.moving, std::memory_order_relaxed);
+    segment->online.store(state.online, std::memory_order_relaxed);
+
+    segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool PositionFeed::read(State &state) const
+{
+    if (segment == nullptr)
+        return false;
+
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++)
+    {
+        uint32_t before = segment->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+
+        State copy;
+        copy.time = segment->time.load(std::memory_order_relaxed);
+        copy.position = segment->position.load(std::memory_order_relaxed);
+        copy.target = segment->target.load(std::memory_order_relaxed);
+        copy.temperature = segment->temperature.load(std::memory_order_relaxed);
+        copy.moving = segment->moving.load(std::memory_order_relaxed);
+        copy.online = segment->online.load(std::memory_order_relaxed);
+        copy.updates = before / 2;
+
+        // The field loads must complete before the sequence is checked again.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segment->sequence.load(std::memory_order_relaxed) == before)
+        {
+            state = copy;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,113 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The PositionFeed class publishes the focuser state in a POSIX shared memory segment.
+ *
+ * The segment holds a single state guarded by a sequence lock: the writer makes the
+ * sequence odd, stores the fields and makes it even again, and a reader retries while the
+ * sequence is odd or changed under it. Neither side ever blocks or makes a system
+ * call, so processes on the same host read the state without going through indiserver.
+ *
+ * The driver creates the segment, the same class opens it read only in any other process.
+ */
+class PositionFeed
+{
+    public:
+        static const uint32_t VERSION { 1 };
+        static const int MAX_NAME { 64 };
+
+        struct State
+        {
+            // Microseconds since the epoch of the last update
+            int64_t time { 0 };
+            int32_t position { 0 };
+            int32_t target { 0 };
+            // Celsius
+            float temperature { 0 };
+            uint8_t moving { 0 };
+            // Cleared when the driver disconnects
+            uint8_t online { 0 };
+            // Updates published since the segment was created
+            uint32_t updates { 0 };
+        };
+
+        PositionFeed() = default;
+        ~PositionFeed();
+
+        PositionFeed(const PositionFeed &) = delete;
+        PositionFeed &operator=(const PositionFeed &) = delete;
+
+        /**
+         * @brief segmentName Shared memory name of device, "/astrostep_" followed by the device
+         * name with anything but letters and digits replaced by '_'.
+         */
+        static void segmentName(const char * device, char * name, size_t len);
+
+        // Create or reuse the segment name for writing.
+        bool create(const char * name);
+
+        // Map the segment name read only.
+        bool open(const char * name);
+
+        /**
+         * @brief close Unmap the segment. The writer marks the state offline and removes
+         * the name, readers still mapping it keep the last state.
+         */
+        void close();
+
+        bool isOpen() const
+        {
+            return segment != nullptr;
+        }
+
+        // Store state, stamped now if its time is 0. Only one process may write.
+        void publish(State state);
+
+        // Copy a consistent state, false if the writer kept it busy for every attempt.
+        bool read(State &state) const;
+
+    private:
+        static const int MAX_ATTEMPTS { 1000 };
+
+        struct Segment
+        {
+            char magic[8];
+            uint32_t version;
+            // Odd while the writer is storing the fields
+            std::atomic<uint32_t> sequence;
+            std::atomic<int64_t> time;
+            std::atomic<int32_t> position;
+            std::atomic<int32_t> target;
+            std::atomic<float> temperature;
+            std::atomic<uint8_t> moving;
+            std::atomic<uint8_t> online;
+        };
+
+        Segment * segment { nullptr };
+        bool writer { false };
+        char segmentPath[MAX_NAME] = {0};
+};
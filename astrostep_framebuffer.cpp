@@ -0,0 +1,142 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_framebuffer.h"
+
+#include <cerrno>
+
+#include <poll.h>
+#include <unistd.h>
+
+const size_t FrameBuffer::SIZE;
+const char FrameBuffer::DELIMITER;
+const char FrameBuffer::START;
+
+void FrameBuffer::clear()
+{
+    head = tail = 0;
+}
+
+void FrameBuffer::drop(size_t len)
+{
+    head += len;
+    discardedBytes += len;
+}
+
+void FrameBuffer::append(const char * bytes, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (available() == SIZE)
+            drop(1);
+        data[tail & (SIZE - 1)] = bytes[i];
+        tail++;
+    }
+}
+
+ssize_t FrameBuffer::fill(int fd, int timeout)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    int rc = 0;
+    do
+    {
+        rc = poll(&pfd, 1, timeout);
+    }
+    while (rc < 0 && errno == EINTR);
+
+    if (rc < 0)
+        return -1;
+    if (rc == 0)
+        return 0;
+
+    // Read only what fits, so a burst waits in the port instead of overwriting a partial frame.
+    // A full buffer holds no terminator and is garbage anyway, let append drop it.
+    char bytes[SIZE];
+    size_t room = (available() < SIZE) ? SIZE - available() : SIZE;
+    ssize_t nbytes = ::read(fd, bytes, room);
+    // Readable but nothing to read means the other end is gone.
+    if (nbytes <= 0)
+        return -1;
+
+    append(bytes, static_cast<size_t>(nbytes));
+    return nbytes;
+}
+
+bool FrameBuffer::nextFrame(char * frame, size_t maxlen)
+{
+    while (true)
+    {
+        // Skip line endings and padding between frames.
+        while (head != tail && (at(head) == '\r' || at(head) == '\n' || at(head) == ' ' || at(head) == '\0'))
+            head++;
+
+        size_t start = head;
+        size_t end = tail;
+        for (size_t i = head; i != tail; i++)
+        {
+            char c = at(i);
+            // A new frame start means whatever preceded it never got its terminator.
+            if (c == START && i != start)
+            {
+                discardedBytes += i - start;
+                start = i;
+            }
+            if (c == DELIMITER)
+            {
+                end = i;
+                break;
+            }
+        }
+        head = start;
+
+        if (end == tail)
+        {
+            // No terminator in sight, drop the runaway frame.
+            if (available() >= maxlen)
+                drop(available());
+            return false;
+        }
+
+        size_t len = end - start + 1;
+        if (len >= maxlen)
+        {
+            drop(len);
+            continue;
+        }
+
+        for (size_t i = 0; i < len; i++)
+            frame[i] = at(start + i);
+        frame[len] = '\0';
+        head = end + 1;
+        return true;
+    }
+}
+
+bool FrameBuffer::read(char * bytes, size_t len)
+{
+    if (available() < len)
+        return false;
+
+    for (size_t i = 0; i < len; i++)
+        bytes[i] = at(head + i);
+    head += len;
+    return true;
+}
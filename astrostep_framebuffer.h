@@ -0,0 +1,106 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+
+/**
+ * @brief The FrameBuffer class keeps the bytes received from the controller across commands
+ * and splits them into '#' terminated frames.
+ *
+ * Partial frames stay buffered until their terminator arrives. Line endings between frames
+ * are skipped, and a ':' inside a pending frame restarts it, so garbage left by a glitch is
+ * dropped at the next frame boundary instead of corrupting every following reply.
+ */
+class FrameBuffer
+{
+    public:
+        // Ring buffer size, must be a power of two.
+        static const size_t SIZE { 256 };
+        static const char DELIMITER { '#' };
+        static const char START { ':' };
+
+        void clear();
+
+        // Number of buffered bytes.
+        size_t available() const
+        {
+            return tail - head;
+        }
+
+        // Number of bytes dropped while resynchronizing or on overflow.
+        uint32_t discarded() const
+        {
+            return discardedBytes;
+        }
+
+        /**
+         * @brief append Add received bytes. The oldest bytes are dropped if the buffer is full.
+         */
+        void append(const char * bytes, size_t len);
+
+        /**
+         * @brief fill Wait up to timeout milliseconds for data on fd and append what fits.
+         * @return Number of bytes read, 0 on timeout, -1 on error or if the peer closed the connection.
+         */
+        ssize_t fill(int fd, int timeout);
+
+        /**
+         * @brief nextFrame Extract the next complete frame, terminator included.
+         * @param frame Destination, NUL terminated.
+         * @param maxlen Size of frame. Longer frames are discarded.
+         * @return True if a frame was extracted, false if no complete frame is buffered.
+         */
+        bool nextFrame(char * frame, size_t maxlen);
+
+        /**
+         * @brief read Extract exactly len raw bytes.
+         * @return True if len bytes were available, false otherwise.
+         */
+        bool read(char * bytes, size_t len);
+
+        // Byte at offset from the oldest buffered one, offset must be below available().
+        uint8_t peek(size_t offset) const
+        {
+            return static_cast<uint8_t>(at(head + offset));
+        }
+
+        // Drop the len oldest bytes, counted as discarded.
+        void discard(size_t len)
+        {
+            drop(len);
+        }
+
+    private:
+        char at(size_t index) const
+        {
+            return data[index & (SIZE - 1)];
+        }
+        void drop(size_t len);
+
+        char data[SIZE] = {0};
+        // Monotonic read and write indexes, masked on access.
+        size_t head { 0 }, tail { 0 };
+        uint32_t discardedBytes { 0 };
+};
@@ -0,0 +1,807 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_io.h"
+#include "astrostep_binary.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+const int IORequest::MAX_COMMANDS;
+const int IORequest::MAX_LENGTH;
+const char IOLoop::EVENT_START;
+const int IOLoop::MAX_EVENTS;
+const int IOMultiplexer::MAX_EVENTS;
+
+bool IORequest::add(const char * command, bool reply)
+{
+    if (count >= MAX_COMMANDS || strlen(command) >= static_cast<size_t>(MAX_LENGTH))
+        return false;
+
+    strncpy(cmd[count], command, MAX_LENGTH - 1);
+    expectReply[count] = reply;
+    count++;
+    priority = std::min(priority, classify(command));
+    return true;
+}
+
+IORequest::Priority IORequest::classify(const char * command)
+{
+    if (command[0] != ':')
+        return PRIORITY_CONFIG;
+
+    const char * code = command + 1;
+    if (strncmp(code, "FQ", 2) == 0)
+        return PRIORITY_ABORT;
+
+    static const char * const motion[] = { "FG", "FT", "SN", "HO", "SP", "SD", "SL", "SY", "SR", "SE", "SM" };
+    for (const char * entry : motion)
+    {
+        if (strncmp(code, entry, 2) == 0)
+            return PRIORITY_MOTION;
+    }
+
+    return (code[0] == 'G') ? PRIORITY_POLL : PRIORITY_CONFIG;
+}
+
+bool IORequest::startsMotion(const char * command)
+{
+    return command[0] == ':' && (strncmp(command + 1, "FG", 2) == 0 || strncmp(command + 1, "FT", 2) == 0 ||
+                                 strncmp(command + 1, "HO", 2) == 0);
+}
+
+bool IORequest::idempotent(const char * command)
+{
+    return command[0] == ':' && command[1] == 'G';
+}
+
+static void makePipe(int fds[2])
+{
+    if (pipe(fds) != 0)
+    {
+        fds[0] = fds[1] = -1;
+        return;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+}
+
+static void drainPipe(int fd)
+{
+    char bytes[64];
+    while (::read(fd, bytes, sizeof(bytes)) > 0)
+        ;
+}
+
+IOLoop::IOLoop()
+{
+    makePipe(notifyPipe);
+}
+
+IOLoop::~IOLoop()
+{
+    close();
+
+    for (int pipeFD : { notifyPipe[0], notifyPipe[1] })
+    {
+        if (pipeFD >= 0)
+            ::close(pipeFD);
+    }
+}
+
+bool IOLoop::open(int portFD)
+{
+    close();
+
+    if (portFD < 0 || notifyPipe[0] < 0)
+        return false;
+
+    fd = portFD;
+    fdError = false;
+    rxBuffer.clear();
+    txLength = txOffset = 0;
+    txWatched = false;
+    // Kept non-blocking while serviced, restored on close().
+    portFlags = fcntl(fd, F_GETFL);
+    if (portFlags >= 0)
+        fcntl(fd, F_SETFL, portFlags | O_NONBLOCK);
+    orphans.clear();
+    abortPending = false;
+    stale = 0;
+    dropped = 0;
+    bytesReceived = bytesSent = 0;
+
+    retriedCount = 0;
+    resetEstimate = true;
+
+    running = true;
+    if (!IOMultiplexer::instance().add(this, fd))
+    {
+        running = false;
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void IOLoop::close()
+{
+    if (running)
+    {
+        running = false;
+        IOMultiplexer::instance().remove(this);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Release anyone blocked in execute().
+    for (auto &request : queue)
+    {
+        request->status = IORequest::IO_CANCELLED;
+        request->finished = true;
+    }
+    if (current)
+    {
+        current->status = IORequest::IO_CANCELLED;
+        current->finished = true;
+        current.reset();
+    }
+    finishedCondition.notify_all();
+
+    queue.clear();
+    done.clear();
+    eventHead = eventCount = 0;
+    drainPipe(notifyPipe[0]);
+
+    txLength = txOffset = 0;
+    if (fd >= 0 && portFlags >= 0)
+        fcntl(fd, F_SETFL, portFlags);
+    portFlags = -1;
+    fd = -1;
+}
+
+void IOLoop::submit(const IORequestPtr &request)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        request->sequence = ++submitted;
+        // Behind every request of the same or a more urgent class
+        auto position = std::find_if(queue.begin(), queue.end(), [&](const IORequestPtr & queued)
+        {
+            return queued->priority > request->priority;
+        });
+        queue.insert(position, request);
+        if (request->priority == IORequest::PRIORITY_ABORT)
+        {
+            abortSequence = request->sequence;
+            abortPending = true;
+        }
+    }
+    IOMultiplexer::instance().wake();
+}
+
+IORequest::Status IOLoop::execute(const IORequestPtr &request)
+{
+    request->synchronous = true;
+
+    if (!running)
+    {
+        request->status = IORequest::IO_CANCELLED;
+        return request->status;
+    }
+
+    submit(request);
+
+    std::unique_lock<std::mutex> guard(lock);
+    finishedCondition.wait(guard, [&]()
+    {
+        return request->finished;
+    });
+
+    return request->status;
+}
+
+void IOLoop::dispatch()
+{
+    std::deque<IORequestPtr> completed;
+    char pending[MAX_EVENTS][IORequest::MAX_LENGTH];
+    int pendingCount = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        drainPipe(notifyPipe[0]);
+        completed.swap(done);
+
+        for (; pendingCount < eventCount; pendingCount++)
+            memcpy(pending[pendingCount], events[(eventHead + pendingCount) % MAX_EVENTS], IORequest::MAX_LENGTH);
+        eventHead = eventCount = 0;
+    }
+
+    // Order between events and completions is not kept, event consumers must not rely on it.
+    for (int i = 0; i < pendingCount; i++)
+    {
+        if (eventHandler)
+            eventHandler(pending[i]);
+    }
+
+    for (auto &request : completed)
+    {
+        if (request->onComplete)
+            request->onComplete(*request);
+    }
+}
+
+bool IOLoop::flushTx()
+{
+    while (txOffset < txLength)
+    {
+        ssize_t nbytes = ::write(fd, txBuffer + txOffset, txLength - txOffset);
+        if (nbytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // The rest goes out when the port is writable again, waiting here would hold up
+            // every other port of the I/O thread.
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                watchWritable(true);
+                return true;
+            }
+            txLength = txOffset = 0;
+            watchWritable(false);
+            return false;
+        }
+        txOffset += static_cast<size_t>(nbytes);
+        bytesSent += static_cast<uint64_t>(nbytes);
+    }
+
+    txLength = txOffset = 0;
+    watchWritable(false);
+    return true;
+}
+
+void IOLoop::watchWritable(bool enabled)
+{
+    if (enabled != txWatched)
+    {
+        txWatched = enabled;
+        IOMultiplexer::instance().watch(this, enabled);
+    }
+}
+
+int IOLoop::prepare(std::chrono::steady_clock::time_point now)
+{
+    if (abortPending.exchange(false))
+        preempt(now);
+
+    // Requests without replies complete as soon as they are written, keep going until one waits.
+    while (!current && startNext())
+        ;
+
+    if (!current)
+        return -1;
+
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(current->deadline - now).count();
+    return remaining > 0 ? static_cast<int>(remaining) : 0;
+}
+
+void IOLoop::service(uint32_t events)
+{
+    char frame[IORequest::MAX_LENGTH];
+
+    if (!fdError && txLength > 0 && (events & (EPOLLOUT | EPOLLERR)))
+    {
+        if (!flushTx())
+        {
+            if (current)
+                complete(IORequest::IO_WRITE_ERROR);
+        }
+        else if (txLength == 0)
+            pump();
+    }
+
+    if (!fdError && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+    {
+        ssize_t nbytes = rxBuffer.fill(fd, 0);
+        if (nbytes > 0)
+            bytesReceived += static_cast<uint64_t>(nbytes);
+        else if (nbytes < 0)
+        {
+            fdError = true;
+            if (current)
+                complete(IORequest::IO_READ_ERROR);
+        }
+    }
+
+    if (!binary)
+    {
+        while (rxBuffer.nextFrame(frame, sizeof(frame)))
+            onFrame(frame);
+        return;
+    }
+
+    BinaryProtocol::Result result;
+    while ((result = BinaryProtocol::extract(rxBuffer, frame, sizeof(frame))) != BinaryProtocol::FRAME_NONE)
+    {
+        if (result == BinaryProtocol::FRAME_OK)
+            onFrame(frame);
+        else
+            badFrames++;
+    }
+}
+
+void IOLoop::expire(std::chrono::steady_clock::time_point now)
+{
+    if (!current || now < current->deadline || retry(now))
+        return;
+
+    // Replies still owed may yet arrive, late. Matched in order they would answer the next
+    // request, they are dropped instead.
+    addOrphans(owedReplies(), now);
+    complete(IORequest::IO_TIMEOUT);
+}
+
+int IOLoop::owedReplies() const
+{
+    int owed = 0;
+    for (int i = current->waiting; i < current->written; i++)
+    {
+        if (current->expectReply[i])
+            owed++;
+    }
+    return owed;
+}
+
+void IOLoop::addOrphans(int count, std::chrono::steady_clock::time_point now)
+{
+    if (count == 0)
+        return;
+
+    // Late replies arrive in the order their commands were written, so do the groups. They
+    // are waited for up to the reply timeout ceiling, not the adaptive timeout that just
+    // proved too short: a reply arriving after its group expired would answer the next
+    // request, and every later group would then drop the reply after its own.
+    OrphanGroup group;
+    group.count = count;
+    group.deadline = now + std::chrono::milliseconds(timeout.load());
+    orphans.push_back(group);
+}
+
+bool IOLoop::retry(std::chrono::steady_clock::time_point now)
+{
+    if (current->retried >= retries || fdError)
+        return false;
+
+    // A repeated move or setting could act twice, only queries are sent again.
+    for (int i = current->waiting; i < current->count; i++)
+    {
+        if (!IORequest::idempotent(current->cmd[i]))
+            return false;
+    }
+
+    current->retried++;
+    retriedCount++;
+
+    // Replies carry no tag, so the late replies of the previous attempt, a partial one
+    // included, are dropped rather than taken for those of this one.
+    addOrphans(owedReplies(), now);
+    current->written = current->waiting;
+    current->deadline = now + replyTimeout() * (current->retried + 1);
+    pump();
+    return true;
+}
+
+void IOLoop::setAdaptiveTimeout(bool enabled, int milliseconds)
+{
+    adaptive = enabled;
+    margin = milliseconds;
+    resetEstimate = true;
+}
+
+void IOLoop::sample(std::chrono::steady_clock::duration gap)
+{
+    double rtt = std::chrono::duration<double, std::micro>(gap).count();
+
+    if (resetEstimate.exchange(false))
+        hasEstimate = false;
+
+    // Same estimator as TCP (RFC 6298).
+    if (!hasEstimate)
+    {
+        smoothedRTT = rtt;
+        deviationRTT = rtt / 2;
+        hasEstimate = true;
+    }
+    else
+    {
+        deviationRTT = 0.75 * deviationRTT + 0.25 * std::fabs(smoothedRTT - rtt);
+        smoothedRTT = 0.875 * smoothedRTT + 0.125 * rtt;
+    }
+}
+
+std::chrono::milliseconds IOLoop::replyTimeout()
+{
+    int ceiling = timeout;
+    int value = ceiling;
+
+    if (adaptive && hasEstimate && !resetEstimate)
+        value = std::min(ceiling, static_cast<int>((smoothedRTT + 4 * deviationRTT) / 1000) + margin);
+
+    effectiveTimeout = value;
+    return std::chrono::milliseconds(value);
+}
+
+bool IOLoop::startNext()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (queue.empty())
+            return false;
+        current = queue.front();
+        queue.pop_front();
+    }
+
+    current->written = current->waiting = 0;
+    // Runs while the port still holds the previous commands, restarted once these are written.
+    current->deadline = std::chrono::steady_clock::now() + replyTimeout();
+
+    if (fdError)
+    {
+        complete(IORequest::IO_READ_ERROR);
+        return true;
+    }
+
+    pump();
+    return true;
+}
+
+void IOLoop::preempt(std::chrono::steady_clock::time_point now)
+{
+    // A move queued before the stop would run after it. One submitted since is meant to.
+    std::vector<IORequestPtr> cancelled;
+    uint64_t stop = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = abortSequence;
+        for (auto it = queue.begin(); it != queue.end();)
+        {
+            const IORequest &queued = **it;
+            bool moves = false;
+            for (int i = 0; i < queued.count && queued.priority != IORequest::PRIORITY_ABORT && queued.sequence < stop; i++)
+                moves = moves || IORequest::startsMotion(queued.cmd[i]);
+
+            if (moves)
+            {
+                cancelled.push_back(*it);
+                it = queue.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+    for (auto &request : cancelled)
+        finish(request, IORequest::IO_CANCELLED);
+
+    if (!current || current->priority == IORequest::PRIORITY_ABORT || current->sequence > stop)
+        return;
+
+    // Commands already written without reply are done, only queries can be abandoned.
+    for (int i = current->waiting; i < current->count; i++)
+    {
+        if (!IORequest::idempotent(current->cmd[i]))
+            return;
+    }
+
+    addOrphans(owedReplies(), now);
+    preempted++;
+    complete(IORequest::IO_CANCELLED);
+}
+
+void IOLoop::pump()
+{
+    while (current)
+    {
+        // Commands without a reply are done as soon as they are written.
+        while (current->waiting < current->written && !current->expectReply[current->waiting])
+            current->waiting++;
+
+        if (current->waiting == current->count)
+        {
+            complete(IORequest::IO_OK);
+            return;
+        }
+
+        // Still waiting for a reply, and the firmware takes one command at a time.
+        if (current->written == current->count || (!pipelined && current->waiting < current->written))
+            return;
+
+        // The port has not taken the previous commands yet, these follow once it has.
+        if (txLength > 0)
+            return;
+
+        char * batch = txBuffer;
+        size_t len = 0;
+        int first = current->written;
+        int last = pipelined ? current->count : first + 1;
+        for (int i = first; i < last; i++)
+        {
+            // Anything without a binary form goes out as ASCII, which the controller always
+            // accepts. Its reply would be ASCII too, so only commands without one can do that.
+            size_t n = binary ? BinaryProtocol::encodeCommand(current->cmd[i], reinterpret_cast<uint8_t *>(batch + len),
+                       sizeof(txBuffer) - len) : 0;
+            if (n == 0)
+            {
+                n = std::min(strlen(current->cmd[i]), sizeof(txBuffer) - len);
+                memcpy(batch + len, current->cmd[i], n);
+            }
+            len += n;
+        }
+
+        txLength = len;
+        txOffset = 0;
+        if (!flushTx())
+        {
+            current->failed = first;
+            complete(IORequest::IO_WRITE_ERROR);
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (int i = first; i < last; i++)
+            current->sentAt[i] = now;
+        current->written = last;
+        // A retried query gets twice the time, the link is evidently slower than estimated.
+        current->deadline = now + replyTimeout() * (current->retried + 1);
+    }
+}
+
+void IOLoop::onFrame(const char * frame)
+{
+    if (frame[0] == EVENT_START)
+    {
+        onEvent(frame);
+        return;
+    }
+
+    // The late reply of an abandoned query, owed by the oldest group. Past its deadline a
+    // group's replies are not coming any more.
+    auto now = std::chrono::steady_clock::now();
+    while (!orphans.empty() && now >= orphans.front().deadline)
+        orphans.pop_front();
+    if (!orphans.empty())
+    {
+        if (--orphans.front().count == 0)
+            orphans.pop_front();
+        return;
+    }
+
+    if (!current || current->waiting >= current->written)
+    {
+        stale++;
+        return;
+    }
+
+    int index = current->waiting;
+    strncpy(current->res[index], frame, IORequest::MAX_LENGTH - 1);
+    current->received[index] = true;
+    current->waiting++;
+
+    current->latency[index] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>
+                              (now - current->sentAt[index]).count());
+
+    // The deadline covers the time since the command was written or the previous reply,
+    // whichever is later, so that is the round trip to learn from.
+    auto start = current->sentAt[index];
+    if (index > 0 && current->received[index - 1] && current->repliedAt > start)
+        start = current->repliedAt;
+    current->repliedAt = now;
+    if (current->retried == 0)
+        sample(now - start);
+
+    current->deadline = now + replyTimeout();
+
+    pump();
+}
+
+void IOLoop::onEvent(const char * frame)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (eventCount == MAX_EVENTS)
+    {
+        eventHead = (eventHead + 1) % MAX_EVENTS;
+        eventCount--;
+        dropped++;
+    }
+
+    char * slot = events[(eventHead + eventCount) % MAX_EVENTS];
+    strncpy(slot, frame, IORequest::MAX_LENGTH - 1);
+    slot[IORequest::MAX_LENGTH - 1] = '\0';
+    eventCount++;
+
+    char byte = 0;
+    ssize_t rc = ::write(notifyPipe[1], &byte, 1);
+    (void)rc;
+}
+
+void IOLoop::complete(IORequest::Status status)
+{
+    IORequestPtr request;
+    request.swap(current);
+    finish(request, status);
+}
+
+void IOLoop::finish(const IORequestPtr &request, IORequest::Status status)
+{
+    request->status = status;
+    if (status != IORequest::IO_OK && request->failed < 0)
+        request->failed = request->waiting;
+
+    std::lock_guard<std::mutex> guard(lock);
+    request->finished = true;
+
+    if (request->synchronous)
+    {
+        finishedCondition.notify_all();
+        return;
+    }
+
+    done.push_back(request);
+    char byte = 0;
+    ssize_t rc = ::write(notifyPipe[1], &byte, 1);
+    (void)rc;
+}
+
+IOMultiplexer &IOMultiplexer::instance()
+{
+    static IOMultiplexer * multiplexer = new IOMultiplexer();
+    return *multiplexer;
+}
+
+IOMultiplexer::IOMultiplexer()
+{
+    makePipe(wakePipe);
+    epollFD = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epollFD >= 0 && wakePipe[0] >= 0)
+    {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        epoll_ctl(epollFD, EPOLL_CTL_ADD, wakePipe[0], &event);
+
+        std::thread(&IOMultiplexer::run, this).detach();
+    }
+}
+
+bool IOMultiplexer::add(IOLoop * loop, int fd)
+{
+    if (epollFD < 0)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = loop;
+        if (epoll_ctl(epollFD, EPOLL_CTL_ADD, fd, &event) != 0)
+            return false;
+
+        loops.push_back(loop);
+    }
+
+    wake();
+    return true;
+}
+
+void IOMultiplexer::watch(IOLoop * loop, bool writable)
+{
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    if (writable)
+        event.events |= EPOLLOUT;
+    event.data.ptr = loop;
+    epoll_ctl(epollFD, EPOLL_CTL_MOD, loop->fd, &event);
+}
+
+void IOMultiplexer::remove(IOLoop * loop)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    epoll_ctl(epollFD, EPOLL_CTL_DEL, loop->fd, nullptr);
+    loops.erase(std::remove(loops.begin(), loops.end(), loop), loops.end());
+}
+
+bool IOMultiplexer::contains(IOLoop * loop) const
+{
+    return std::find(loops.begin(), loops.end(), loop) != loops.end();
+}
+
+void IOMultiplexer::wake()
+{
+    if (wakePipe[1] >= 0)
+    {
+        char byte = 0;
+        ssize_t rc = ::write(wakePipe[1], &byte, 1);
+        (void)rc;
+    }
+}
+
+void IOMultiplexer::run()
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (true)
+    {
+        int wait = -1;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto now = std::chrono::steady_clock::now();
+            for (IOLoop * loop : loops)
+            {
+                int remaining = loop->prepare(now);
+                if (remaining >= 0 && (wait < 0 || remaining < wait))
+                    wait = remaining;
+            }
+        }
+
+        int count = epoll_wait(epollFD, events, MAX_EVENTS, wait);
+        if (count < 0)
+            count = 0;
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        for (int i = 0; i < count; i++)
+        {
+            IOLoop * loop = static_cast<IOLoop *>(events[i].data.ptr);
+            if (loop == nullptr)
+            {
+                drainPipe(wakePipe[0]);
+                continue;
+            }
+
+            // The loop may have been removed while we were waiting.
+            if (!contains(loop))
+                continue;
+
+            loop->service(events[i].events);
+
+            // Stop watching a dead port, it would report ready forever.
+            if (loop->fdError)
+                epoll_ctl(epollFD, EPOLL_CTL_DEL, loop->fd, nullptr);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (IOLoop * loop : loops)
+            loop->expire(now);
+    }
+}
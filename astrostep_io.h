@@ -0,0 +1,389 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include "astrostep_framebuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The IORequest struct is a batch of commands executed back to back by the IOLoop.
+ */
+struct IORequest
+{
+    static const int MAX_COMMANDS { 8 };
+    static const int MAX_LENGTH { 32 };
+
+    typedef enum { IO_PENDING, IO_OK, IO_WRITE_ERROR, IO_READ_ERROR, IO_TIMEOUT, IO_CANCELLED } Status;
+    // Scheduling classes, most urgent first
+    typedef enum { PRIORITY_ABORT, PRIORITY_MOTION, PRIORITY_CONFIG, PRIORITY_POLL } Priority;
+
+    /**
+     * @brief add Append a command to the batch. The batch takes the most urgent class of its commands.
+     * @param command Command to be sent, must already have the necessary delimeter ('#')
+     * @param reply True if the controller answers this command.
+     * @return False if the batch is full or the command too long.
+     */
+    bool add(const char * command, bool reply = true);
+
+    /**
+     * @brief classify Scheduling class of command: stop (:FQ#), then motion and what a move
+     * depends on (position, speed, profiles, direction, coil power, step mode), then other
+     * settings, then queries.
+     */
+    static Priority classify(const char * command);
+
+    // True if command starts a motion (:FG#, :FT#, :HO#).
+    static bool startsMotion(const char * command);
+
+    /**
+     * @brief idempotent True if sending command twice is harmless. Only queries (:Gx#) are,
+     * moves and setters are never repeated.
+     */
+    static bool idempotent(const char * command);
+
+    int count { 0 };
+    Priority priority { PRIORITY_POLL };
+    char cmd[MAX_COMMANDS][MAX_LENGTH] = {{0}};
+    bool expectReply[MAX_COMMANDS] = {false};
+    char res[MAX_COMMANDS][MAX_LENGTH] = {{0}};
+    bool received[MAX_COMMANDS] = {false};
+
+    Status status { IO_PENDING };
+    // Index of the command that failed, -1 if none.
+    int failed { -1 };
+
+    // Called from IOLoop::dispatch() once the request is complete.
+    std::function<void(IORequest &)> onComplete;
+
+    // Time from writing each command to its reply, in microseconds
+    uint32_t latency[MAX_COMMANDS] = {0};
+
+    // Progress, only touched by the I/O thread.
+    std::chrono::steady_clock::time_point sentAt[MAX_COMMANDS];
+    int written { 0 };
+    int waiting { 0 };
+    int retried { 0 };
+    std::chrono::steady_clock::time_point repliedAt;
+    std::chrono::steady_clock::time_point deadline;
+    bool synchronous { false };
+    bool finished { false };
+    // Submission order, set by IOLoop::submit()
+    uint64_t sequence { 0 };
+};
+
+typedef std::shared_ptr<IORequest> IORequestPtr;
+
+class IOLoop;
+
+/**
+ * @brief The IOMultiplexer class services the ports of every IOLoop in the process from one thread.
+ *
+ * Ports are watched with a single epoll set, and the thread sleeps until a port is readable,
+ * a request is submitted or the earliest reply deadline of any loop expires. Several
+ * controllers in one driver process thus share one I/O thread.
+ */
+class IOMultiplexer
+{
+    public:
+        // Created on first use and never destroyed, so loops can close during static destruction.
+        static IOMultiplexer &instance();
+
+        bool add(IOLoop * loop, int fd);
+
+        /**
+         * @brief remove Stop servicing loop. Once this returns the I/O thread no longer touches it.
+         */
+        void remove(IOLoop * loop);
+
+        void wake();
+
+    private:
+        static const int MAX_EVENTS { 16 };
+
+        IOMultiplexer();
+
+        friend class IOLoop;
+
+        void run();
+        bool contains(IOLoop * loop) const;
+        // Called with the lock held. Also wake up when the port of loop becomes writable.
+        void watch(IOLoop * loop, bool writable);
+
+        int epollFD { -1 };
+        int wakePipe[2] = { -1, -1 };
+        // Held by the I/O thread while it services loops, never while it waits.
+        std::mutex lock;
+        std::vector<IOLoop *> loops;
+};
+
+/**
+ * @brief The IOLoop class runs all the serial traffic of a controller on the shared I/O thread.
+ *
+ * Requests are executed by priority class, in submission order within a class. A stop
+ * request cancels the queued moves, and a query request waiting for its replies; the
+ * replies still owed are discarded as they arrive. So are the late replies of a timed out
+ * request, and those of the previous attempt of a retried query. Replies are matched in
+ * order as '#' frames arrive, either with all the commands of a request written at once
+ * (pipelined firmware) or one command per reply. Completed requests are queued and
+ * notifyFD() becomes readable; the owner then calls dispatch() from its own thread to run
+ * the completion callbacks.
+ *
+ * The port is non-blocking while open. Commands it does not take at once are kept and
+ * written when it becomes writable, so a stuck port never holds up the other loops.
+ *
+ * Frames starting with EVENT_START are unsolicited events pushed by the controller. They are
+ * never matched against a request and are handed to the event handler from dispatch().
+ */
+class IOLoop
+{
+    public:
+        static const char EVENT_START { '!' };
+        // Events kept until the next dispatch(), the oldest are dropped beyond that
+        static const int MAX_EVENTS { 16 };
+
+        IOLoop();
+        ~IOLoop();
+
+        /**
+         * @brief open Start servicing fd on the I/O thread.
+         */
+        bool open(int fd);
+
+        /**
+         * @brief close Stop the I/O thread. Pending requests are dropped without completion.
+         */
+        void close();
+
+        bool isOpen() const
+        {
+            return running;
+        }
+
+        // Readable when completed requests are waiting for dispatch().
+        int notifyFD() const
+        {
+            return notifyPipe[0];
+        }
+
+        void setPipelined(bool enabled)
+        {
+            pipelined = enabled;
+        }
+
+        // Exchange BinaryProtocol frames instead of ASCII, from the next command written.
+        void setBinary(bool enabled)
+        {
+            binary = enabled;
+        }
+
+        bool isBinary() const
+        {
+            return binary;
+        }
+
+        // Time allowed for each reply in milliseconds, the ceiling when the timeout is adaptive.
+        void setTimeout(int milliseconds)
+        {
+            timeout = milliseconds;
+        }
+
+        /**
+         * @brief setAdaptiveTimeout Derive the reply timeout from the measured round trips.
+         * The timeout becomes the smoothed round trip plus four deviations plus margin, capped
+         * by setTimeout(). Round trip statistics are reset.
+         * @param margin Extra milliseconds for the link type, larger for network links.
+         */
+        void setAdaptiveTimeout(bool enabled, int margin);
+
+        // Times a query is sent again after a timeout, requests with other commands are never retried.
+        void setRetries(int count)
+        {
+            retries = count;
+        }
+
+        // Reply timeout currently in use, in milliseconds.
+        int currentTimeout() const
+        {
+            return effectiveTimeout;
+        }
+
+        // Queries sent again after a timeout.
+        uint32_t retriedCommands() const
+        {
+            return retriedCount;
+        }
+
+        // Called from dispatch() with each unsolicited event frame.
+        void setEventHandler(std::function<void(const char *)> handler)
+        {
+            eventHandler = handler;
+        }
+
+        /**
+         * @brief submit Queue a request. Its onComplete runs from dispatch().
+         */
+        void submit(const IORequestPtr &request);
+
+        /**
+         * @brief execute Queue a request and block until it completes. onComplete is not called.
+         * @return Final status of the request.
+         */
+        IORequest::Status execute(const IORequestPtr &request);
+
+        /**
+         * @brief dispatch Run the completion callbacks of all completed requests.
+         */
+        void dispatch();
+
+        // Frames received while no reply was expected.
+        uint32_t staleFrames() const
+        {
+            return stale;
+        }
+
+        uint64_t bytesIn() const
+        {
+            return bytesReceived;
+        }
+
+        uint64_t bytesOut() const
+        {
+            return bytesSent;
+        }
+
+        // Events dropped because dispatch() did not keep up.
+        uint32_t droppedEvents() const
+        {
+            return dropped;
+        }
+
+        // Binary frames rejected by their CRC.
+        uint32_t crcErrors() const
+        {
+            return badFrames;
+        }
+
+        // Query requests cancelled by a stop request.
+        uint32_t preemptedRequests() const
+        {
+            return preempted;
+        }
+
+    private:
+        friend class IOMultiplexer;
+
+        // Called by the I/O thread with the multiplexer locked.
+        // Start the next request if idle, and return the milliseconds until its reply deadline, -1 if none.
+        int prepare(std::chrono::steady_clock::time_point now);
+        void service(uint32_t events);
+        void expire(std::chrono::steady_clock::time_point now);
+
+        // False if the queue is empty
+        bool startNext();
+        // Cancel queued moves for a stop request, and the current request if it only holds queries
+        void preempt(std::chrono::steady_clock::time_point now);
+        // Replies the current attempt is still waiting for
+        int owedReplies() const;
+        // Drop the count replies that arrive after those of the previous groups
+        void addOrphans(int count, std::chrono::steady_clock::time_point now);
+        void pump();
+        void onFrame(const char * frame);
+        void onEvent(const char * frame);
+        void complete(IORequest::Status status);
+        void finish(const IORequestPtr &request, IORequest::Status status);
+        // Account a reply gap in the round trip estimate
+        void sample(std::chrono::steady_clock::duration gap);
+        std::chrono::milliseconds replyTimeout();
+        // Send the unanswered queries of the current request again, false if not allowed
+        bool retry(std::chrono::steady_clock::time_point now);
+        // Write the pending bytes the port takes, false on a write error
+        bool flushTx();
+        void watchWritable(bool enabled);
+
+        int fd { -1 };
+        bool fdError { false };
+        // Flags of the port before open(), restored by close()
+        int portFlags { -1 };
+        FrameBuffer rxBuffer;
+        // Commands written but not yet taken by the port, and whether EPOLLOUT is watched for
+        // them. Only touched by the I/O thread.
+        char txBuffer[IORequest::MAX_LENGTH * IORequest::MAX_COMMANDS] = {0};
+        size_t txLength { 0 };
+        size_t txOffset { 0 };
+        bool txWatched { false };
+
+        std::atomic<bool> running { false };
+        std::atomic<bool> pipelined { false };
+        std::atomic<bool> binary { false };
+        std::atomic<int> timeout { 3000 };
+        std::atomic<bool> adaptive { false };
+        std::atomic<int> margin { 0 };
+        std::atomic<int> retries { 0 };
+        std::atomic<int> effectiveTimeout { 3000 };
+        std::atomic<uint32_t> retriedCount { 0 };
+        // Round trip estimate in microseconds, only touched by the I/O thread
+        std::atomic<bool> resetEstimate { false };
+        double smoothedRTT { 0 };
+        double deviationRTT { 0 };
+        bool hasEstimate { false };
+        std::atomic<uint32_t> stale { 0 };
+        std::atomic<uint32_t> dropped { 0 };
+        std::atomic<uint32_t> badFrames { 0 };
+        std::atomic<uint32_t> preempted { 0 };
+        // A stop request was submitted
+        std::atomic<bool> abortPending { false };
+        // Requests submitted, and the sequence of the latest stop request, both under lock
+        uint64_t submitted { 0 };
+        uint64_t abortSequence { 0 };
+        // Replies owed to preempted, retried or timed out requests, oldest first. The replies
+        // of a group are dropped as they arrive, until its deadline. Only touched by the I/O thread.
+        struct OrphanGroup
+        {
+            int count;
+            std::chrono::steady_clock::time_point deadline;
+        };
+        std::deque<OrphanGroup> orphans;
+        std::atomic<uint64_t> bytesReceived { 0 };
+        std::atomic<uint64_t> bytesSent { 0 };
+
+        std::mutex lock;
+        std::condition_variable finishedCondition;
+        std::deque<IORequestPtr> queue;
+        std::deque<IORequestPtr> done;
+        // Ring of event frames waiting for dispatch()
+        char events[MAX_EVENTS][IORequest::MAX_LENGTH] = {{0}};
+        int eventHead { 0 };
+        int eventCount { 0 };
+        std::function<void(const char *)> eventHandler;
+        // Only touched by the I/O thread.
+        IORequestPtr current;
+
+        int notifyPipe[2] = { -1, -1 };
+};
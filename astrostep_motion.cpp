@@ -0,0 +1,183 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_motion.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int MotionTracker::SETTLE_SAMPLES;
+const int MotionTracker::STALL_SAMPLES;
+
+void MotionTracker::start(uint32_t target)
+{
+    current = MOTION_MOVING;
+    goal = target;
+    hasSample = false;
+    atTarget = unchanged = 0;
+}
+
+void MotionTracker::stop()
+{
+    current = MOTION_IDLE;
+}
+
+MotionTracker::State MotionTracker::sample(uint32_t position)
+{
+    if (current == MOTION_IDLE || current == MOTION_DONE)
+        return current;
+
+    unchanged = (hasSample && position == lastPosition) ? unchanged + 1 : 0;
+    lastPosition = position;
+    hasSample = true;
+
+    if (position == goal)
+    {
+        atTarget++;
+        current = (atTarget >= SETTLE_SAMPLES) ? MOTION_DONE : MOTION_SETTLING;
+        return current;
+    }
+
+    // The motor has not started yet, or stopped short of the target.
+    atTarget = 0;
+    current = (unchanged >= STALL_SAMPLES) ? MOTION_STALLED : MOTION_MOVING;
+    return current;
+}
+
+void MotionModel::start(double position, double target, double speed, double acceleration, TimePoint now)
+{
+    from = position;
+    to = target;
+    cruise = std::max(speed, 1.0);
+    accel = std::max(acceleration, 0.0);
+    anchor = now;
+    isActive = true;
+    plan(0);
+}
+
+void MotionModel::stop()
+{
+    isActive = false;
+}
+
+void MotionModel::correct(double position, TimePoint now)
+{
+    if (!isActive)
+        return;
+
+    // Keep the direction: a sample past the target only means the move is about to end.
+    double velocity = velocityAt(elapsed(now));
+    bool outward = to >= from;
+    from = outward ? std::min(position, to) : std::max(position, to);
+    anchor = now;
+    plan(velocity);
+}
+
+double MotionModel::predict(TimePoint now) const
+{
+    if (!isActive)
+        return to;
+
+    double distance = distanceAt(elapsed(now));
+    return (to >= from) ? from + distance : from - distance;
+}
+
+std::chrono::milliseconds MotionModel::remaining(TimePoint now) const
+{
+    if (!isActive)
+        return std::chrono::milliseconds(0);
+
+    double left = accelTime + cruiseTime + decelTime - elapsed(now);
+    return std::chrono::milliseconds(static_cast<int64_t>(std::max(0.0, left) * 1000));
+}
+
+void MotionModel::plan(double v0)
+{
+    double distance = std::fabs(to - from);
+    initial = std::min(v0, cruise);
+
+    if (accel <= 0)
+    {
+        initial = peak = cruise;
+        accelTime = decelTime = 0;
+        cruiseTime = distance / cruise;
+        return;
+    }
+
+    // Highest speed from which the motor can still stop on the target.
+    double reachable = std::sqrt((2 * accel * distance + initial * initial) / 2);
+    peak = std::min(cruise, reachable);
+
+    // Already too fast to stop in time, decelerate all the way.
+    if (peak < initial)
+    {
+        peak = initial;
+        accelTime = cruiseTime = 0;
+        decelTime = (initial > 0) ? 2 * distance / initial : 0;
+        return;
+    }
+
+    accelTime = (peak - initial) / accel;
+    decelTime = peak / accel;
+    double accelDistance = (peak * peak - initial * initial) / (2 * accel);
+    double decelDistance = peak * peak / (2 * accel);
+    cruiseTime = std::max(0.0, distance - accelDistance - decelDistance) / peak;
+}
+
+double MotionModel::elapsed(TimePoint now) const
+{
+    return std::max(0.0, std::chrono::duration<double>(now - anchor).count());
+}
+
+double MotionModel::distanceAt(double t) const
+{
+    double distance = std::fabs(to - from);
+
+    if (t < accelTime)
+        return std::min(distance, initial * t + (peak - initial) / accelTime * t * t / 2);
+
+    double covered = (initial + peak) / 2 * accelTime;
+    t -= accelTime;
+    if (t < cruiseTime)
+        return std::min(distance, covered + peak * t);
+
+    covered += peak * cruiseTime;
+    t -= cruiseTime;
+    if (t < decelTime)
+        return std::min(distance, covered + peak * t - peak / decelTime * t * t / 2);
+
+    return distance;
+}
+
+double MotionModel::velocityAt(double t) const
+{
+    if (t < accelTime)
+        return initial + (peak - initial) * t / accelTime;
+
+    t -= accelTime;
+    if (t < cruiseTime)
+        return peak;
+
+    t -= cruiseTime;
+    if (t < decelTime)
+        return peak * (1 - t / decelTime);
+
+    return 0;
+}
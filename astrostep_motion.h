@@ -0,0 +1,131 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief The MotionTracker class tells from position samples alone when a move is complete.
+ *
+ * A move is done once the position equals the target for SETTLE_SAMPLES samples in a row.
+ * A position that stops changing away from the target (stall, limit, abort from another
+ * client) is reported as stalled after STALL_SAMPLES samples, and only then does the motion
+ * flag have to be asked from the controller.
+ */
+class MotionTracker
+{
+    public:
+        typedef enum { MOTION_IDLE, MOTION_MOVING, MOTION_SETTLING, MOTION_DONE, MOTION_STALLED } State;
+
+        static const int SETTLE_SAMPLES { 2 };
+        static const int STALL_SAMPLES { 4 };
+
+        // A move to target was commanded.
+        void start(uint32_t target);
+
+        // The move ended, or was confirmed complete by the controller.
+        void stop();
+
+        /**
+         * @brief sample Account a position read while the move is in progress.
+         * @return State after the sample. MOTION_IDLE if no move is tracked.
+         */
+        State sample(uint32_t position);
+
+        State state() const
+        {
+            return current;
+        }
+
+        uint32_t target() const
+        {
+            return goal;
+        }
+
+    private:
+        State current { MOTION_IDLE };
+        uint32_t goal { 0 };
+        uint32_t lastPosition { 0 };
+        bool hasSample { false };
+        // Consecutive samples at the target, and without any change of position
+        int atTarget { 0 };
+        int unchanged { 0 };
+};
+
+/**
+ * @brief The MotionModel class predicts the position of a move between position samples.
+ *
+ * The move follows a trapezoidal profile: accelerate to the speed, cruise, decelerate onto
+ * the target. Without acceleration the speed is reached at once, as with the firmware's
+ * constant speed stepping. Each measured position re-anchors the profile at that position
+ * with the velocity predicted for that instant, so errors do not accumulate.
+ */
+class MotionModel
+{
+    public:
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+        /**
+         * @brief start Model a move from position to target.
+         * @param speed Cruise speed in steps per second.
+         * @param acceleration Steps per second squared, 0 for an immediate change of speed.
+         */
+        void start(double position, double target, double speed, double acceleration, TimePoint now);
+
+        void stop();
+
+        bool active() const
+        {
+            return isActive;
+        }
+
+        // Re-anchor the profile at a measured position.
+        void correct(double position, TimePoint now);
+
+        // Predicted position, the target once the profile ended.
+        double predict(TimePoint now) const;
+
+        // Time until the predicted end of the move.
+        std::chrono::milliseconds remaining(TimePoint now) const;
+
+    private:
+        // Plan the profile from the anchor with initial velocity v0
+        void plan(double v0);
+        double elapsed(TimePoint now) const;
+        // Distance covered t seconds after the anchor, and the velocity then
+        double distanceAt(double t) const;
+        double velocityAt(double t) const;
+
+        bool isActive { false };
+        double from { 0 };
+        double to { 0 };
+        double cruise { 0 };
+        double accel { 0 };
+        TimePoint anchor;
+
+        // Profile from the anchor: initial and peak velocity, duration of each phase
+        double initial { 0 };
+        double peak { 0 };
+        double accelTime { 0 };
+        double cruiseTime { 0 };
+        double decelTime { 0 };
+};
@@ -0,0 +1,117 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_publisher.h"
+
+#include <indidevapi.h>
+
+const int PropertyPublisher::MAX_PROPERTIES;
+
+void PropertyPublisher::update(INumberVectorProperty * nvp)
+{
+    update(nvp, false, nvp->s);
+}
+
+void PropertyPublisher::update(ISwitchVectorProperty * svp)
+{
+    update(svp, true, svp->s);
+}
+
+void PropertyPublisher::sent(INumberVectorProperty * nvp)
+{
+    // Only the state is known to be current, values still pending are sent as usual.
+    Entry * entry = find(nvp);
+    if (entry != nullptr)
+        entry->sentState = nvp->s;
+}
+
+PropertyPublisher::Entry * PropertyPublisher::find(void * property)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (entries[i].property == property)
+            return &entries[i];
+    }
+    return nullptr;
+}
+
+void PropertyPublisher::update(void * property, bool isSwitch, IPState state)
+{
+    Entry * entry = find(property);
+
+    if (entry == nullptr)
+    {
+        // Untracked properties are simply sent, never dropped.
+        if (count == MAX_PROPERTIES)
+        {
+            Entry untracked;
+            untracked.property = property;
+            untracked.isSwitch = isSwitch;
+            send(untracked);
+            return;
+        }
+
+        entry = &entries[count++];
+        *entry = Entry();
+        entry->property = property;
+        entry->isSwitch = isSwitch;
+    }
+
+    entry->dirty = true;
+
+    if (!entry->sentOnce || state != entry->sentState)
+        send(*entry);
+}
+
+void PropertyPublisher::flush()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < count; i++)
+    {
+        if (entries[i].dirty && now - entries[i].sentAt >= minInterval)
+            send(entries[i]);
+    }
+}
+
+void PropertyPublisher::reset()
+{
+    count = 0;
+}
+
+void PropertyPublisher::send(Entry &entry)
+{
+    if (entry.isSwitch)
+    {
+        auto svp = static_cast<ISwitchVectorProperty *>(entry.property);
+        IDSetSwitch(svp, nullptr);
+        entry.sentState = svp->s;
+    }
+    else
+    {
+        auto nvp = static_cast<INumberVectorProperty *>(entry.property);
+        IDSetNumber(nvp, nullptr);
+        entry.sentState = nvp->s;
+    }
+
+    entry.dirty = false;
+    entry.sentOnce = true;
+    entry.sentAt = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,82 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <indiapi.h>
+
+#include <chrono>
+
+/**
+ * @brief The PropertyPublisher class coalesces property updates sent to the clients.
+ *
+ * update() marks a property as changed. flush() sends each changed property at most once,
+ * and no more often than the minimum interval. A change of the property state is never
+ * delayed, it is sent right away together with the latest values. Properties the base
+ * class sends itself are reported with sent(), so that the change is measured from the
+ * state the clients last saw.
+ */
+class PropertyPublisher
+{
+    public:
+        static const int MAX_PROPERTIES { 16 };
+
+        void setMinInterval(int milliseconds)
+        {
+            minInterval = std::chrono::milliseconds(milliseconds);
+        }
+
+        void update(INumberVectorProperty * nvp);
+        void update(ISwitchVectorProperty * svp);
+
+        /**
+         * @brief sent Record the state of a tracked property sent outside the publisher.
+         */
+        void sent(INumberVectorProperty * nvp);
+
+        /**
+         * @brief flush Send the changed properties whose minimum interval has elapsed.
+         */
+        void flush();
+
+        /**
+         * @brief reset Forget all tracked properties, the next update of each is sent at once.
+         */
+        void reset();
+
+    private:
+        struct Entry
+        {
+            void * property { nullptr };
+            bool isSwitch { false };
+            bool dirty { false };
+            bool sentOnce { false };
+            IPState sentState { IPS_IDLE };
+            std::chrono::steady_clock::time_point sentAt;
+        };
+
+        Entry * find(void * property);
+        void update(void * property, bool isSwitch, IPState state);
+        void send(Entry &entry);
+
+        Entry entries[MAX_PROPERTIES];
+        int count { 0 };
+        std::chrono::milliseconds minInterval { 100 };
+};
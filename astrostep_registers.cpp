@@ -0,0 +1,59 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_registers.h"
+
+#include <cstring>
+
+const char * const DeviceRegisters::names[REG_COUNT] =
+{
+    "speed", "coil_power", "reverse", "calibration", "coefficient", "compensation", "stream", "done_events"
+};
+
+void DeviceRegisters::clear()
+{
+    for (bool &k : isKnown)
+        k = false;
+}
+
+void DeviceRegisters::load(FILE * fp)
+{
+    clear();
+
+    char name[32] = {0};
+    int value = 0;
+    while (fscanf(fp, "%31s %d", name, &value) == 2)
+    {
+        for (int i = 0; i < REG_COUNT; i++)
+        {
+            if (strcmp(name, names[i]) == 0)
+                set(static_cast<Register>(i), value);
+        }
+    }
+}
+
+void DeviceRegisters::save(FILE * fp) const
+{
+    for (int i = 0; i < REG_COUNT; i++)
+    {
+        if (isKnown[i])
+            fprintf(fp, "%s %d\n", names[i], values[i]);
+    }
+}
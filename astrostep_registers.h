@@ -0,0 +1,92 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * @brief The DeviceRegisters class shadows the settings held by the controller.
+ *
+ * A register is known once its value was read back or written. Writes of the value a
+ * register already holds are redundant and need not be sent. A failed write makes the
+ * register unknown again, as the controller may or may not have applied it.
+ */
+class DeviceRegisters
+{
+    public:
+        typedef enum
+        {
+            REG_SPEED,
+            REG_COIL_POWER,
+            REG_REVERSE,
+            REG_CALIBRATION,
+            REG_COEFFICIENT,
+            REG_COMPENSATION,
+            REG_STREAM,
+            REG_DONE_EVENTS,
+            REG_COUNT
+        } Register;
+
+        // True if writing value would change the register, always true while it is unknown.
+        bool differs(Register reg, int32_t value) const
+        {
+            return !isKnown[reg] || values[reg] != value;
+        }
+
+        bool known(Register reg) const
+        {
+            return isKnown[reg];
+        }
+
+        int32_t get(Register reg) const
+        {
+            return values[reg];
+        }
+
+        void set(Register reg, int32_t value)
+        {
+            values[reg] = value;
+            isKnown[reg] = true;
+        }
+
+        void invalidate(Register reg)
+        {
+            isKnown[reg] = false;
+        }
+
+        void clear();
+
+        /**
+         * @brief load Read "name value" lines written by save(), unknown names are skipped.
+         * Registers missing from fp stay unknown.
+         */
+        void load(FILE * fp);
+
+        // Write one "name value" line per known register.
+        void save(FILE * fp) const;
+
+    private:
+        static const char * const names[REG_COUNT];
+
+        int32_t values[REG_COUNT] = {0};
+        bool isKnown[REG_COUNT] = {false};
+};
@@ -0,0 +1,215 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_reply.h"
+
+#include <cmath>
+
+const int ReplyParser::MAX_FIELDS;
+
+namespace
+{
+typedef enum { TYPE_INTEGER, TYPE_FIXED, TYPE_FLAG } FieldType;
+
+// Indexed by ReplyParser::Field
+const FieldType fieldTypes[ReplyParser::FIELD_COUNT] =
+{
+    TYPE_INTEGER,   // FIELD_POSITION
+    TYPE_FLAG,      // FIELD_MOVING
+    TYPE_FIXED,     // FIELD_TEMPERATURE
+    TYPE_INTEGER,   // FIELD_SPEED
+    TYPE_FLAG,      // FIELD_COIL_POWER
+    TYPE_FLAG,      // FIELD_REVERSE
+    TYPE_FIXED,     // FIELD_CALIBRATION
+    TYPE_FIXED,     // FIELD_COEFFICIENT
+};
+
+struct Query
+{
+    char code[3];
+    int count;
+    ReplyParser::Field fields[ReplyParser::MAX_FIELDS];
+};
+
+const Query queries[] =
+{
+    { "GP", 1, { ReplyParser::FIELD_POSITION } },
+    { "GI", 1, { ReplyParser::FIELD_MOVING } },
+    { "GT", 1, { ReplyParser::FIELD_TEMPERATURE } },
+    { "GD", 1, { ReplyParser::FIELD_SPEED } },
+    { "GE", 1, { ReplyParser::FIELD_COIL_POWER } },
+    { "GR", 1, { ReplyParser::FIELD_REVERSE } },
+    { "GO", 1, { ReplyParser::FIELD_CALIBRATION } },
+    { "GC", 1, { ReplyParser::FIELD_COEFFICIENT } },
+    // Combined status: position, moving, temperature and coil power, e.g. 12345,1,20.50,1#
+    {
+        "GS", 4, {
+            ReplyParser::FIELD_POSITION, ReplyParser::FIELD_MOVING, ReplyParser::FIELD_TEMPERATURE,
+            ReplyParser::FIELD_COIL_POWER
+        }
+    },
+};
+
+// Unsolicited events, selected by the letter after the '!' marker
+const Query events[] =
+{
+    // Position stream while moving: position and moving flag, e.g. !P12345,1#
+    { "P", 2, { ReplyParser::FIELD_POSITION, ReplyParser::FIELD_MOVING } },
+    // Motion ended at the given position, e.g. !D12345#
+    { "D", 1, { ReplyParser::FIELD_POSITION } },
+};
+
+const Query * findQuery(const char * command)
+{
+    if (command == nullptr || command[0] != ':' || command[1] == '\0')
+        return nullptr;
+
+    for (const auto &query : queries)
+    {
+        if (command[1] == query.code[0] && command[2] == query.code[1])
+            return &query;
+    }
+
+    return nullptr;
+}
+
+bool parseFields(const Query * query, const char * p, ReplyParser::Values &values)
+{
+    // Decoded aside and merged only once the whole frame is valid, a malformed reply such
+    // as "123x#" must not leave its leading fields behind.
+    double decoded[ReplyParser::MAX_FIELDS];
+    for (int i = 0; i < query->count; i++)
+    {
+        if (i > 0 && *p++ != ',')
+            return false;
+
+        double value = 0;
+        if (!ReplyParser::parseNumber(p, value))
+            return false;
+
+        FieldType type = fieldTypes[query->fields[i]];
+        // Flags are 0 or 1, with or without leading zeros (01#).
+        if (type == TYPE_FLAG && value != 0 && value != 1)
+            return false;
+        if (type == TYPE_INTEGER && value != std::floor(value))
+            return false;
+
+        decoded[i] = value;
+    }
+
+    if (*p != '#' && *p != '\0')
+        return false;
+
+    for (int i = 0; i < query->count; i++)
+        values.set(query->fields[i], decoded[i]);
+    return true;
+}
+}
+
+bool ReplyParser::parseNumber(const char * &p, double &value)
+{
+    const char * s = p;
+    bool negative = false;
+    if (*s == '-' || *s == '+')
+        negative = (*s++ == '-');
+
+    double result = 0;
+    bool digits = false;
+    while (*s >= '0' && *s <= '9')
+    {
+        result = result * 10 + (*s++ - '0');
+        digits = true;
+    }
+
+    if (*s == '.')
+    {
+        s++;
+        double scale = 0.1;
+        while (*s >= '0' && *s <= '9')
+        {
+            result += (*s++ - '0') * scale;
+            scale /= 10;
+            digits = true;
+        }
+    }
+
+    if (!digits)
+        return false;
+
+    value = negative ? -result : result;
+    p = s;
+    return true;
+}
+
+bool ReplyParser::parse(const char * command, const char * reply, Values &values)
+{
+    const Query * query = findQuery(command);
+    if (query == nullptr || reply == nullptr)
+        return false;
+
+    return parseFields(query, reply, values);
+}
+
+bool ReplyParser::parseEvent(const char * frame, Values &values)
+{
+    if (frame == nullptr || frame[0] != '!' || frame[1] == '\0')
+        return false;
+
+    for (const auto &event : events)
+    {
+        if (frame[1] != event.code[0])
+            continue;
+
+        if (!parseFields(&event, frame + 2, values))
+            return false;
+        // A move done frame implies the motor stopped.
+        if (event.code[0] == 'D')
+            values.set(FIELD_MOVING, 0);
+        return true;
+    }
+
+    return false;
+}
+
+bool ReplyParser::parseVersion(const char * reply, uint32_t &version)
+{
+    uint32_t parts[3] = {0};
+    const char * p = reply;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (i > 0 && *p++ != '.')
+            break;
+
+        const char * start = p;
+        while (*p >= '0' && *p <= '9')
+            parts[i] = parts[i] * 10 + static_cast<uint32_t>(*p++ - '0');
+
+        if (p == start)
+        {
+            if (i == 0)
+                return false;
+            break;
+        }
+    }
+
+    version = parts[0] * 10000 + parts[1] * 100 + parts[2];
+    return true;
+}
@@ -0,0 +1,101 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The ReplyParser class decodes controller replies through a single command table.
+ *
+ * Each query in the table lists the fields of its reply in order, separated by ',' and
+ * terminated by '#'. Numbers are parsed by hand as fixed point decimals, independent of
+ * the C locale, straight into a Values struct on the caller's stack.
+ */
+class ReplyParser
+{
+    public:
+        typedef enum
+        {
+            FIELD_POSITION,
+            FIELD_MOVING,
+            FIELD_TEMPERATURE,
+            FIELD_SPEED,
+            FIELD_COIL_POWER,
+            FIELD_REVERSE,
+            FIELD_CALIBRATION,
+            FIELD_COEFFICIENT,
+            FIELD_COUNT
+        } Field;
+
+        static const int MAX_FIELDS { 4 };
+
+        struct Values
+        {
+            bool has(Field field) const
+            {
+                return present & (1u << field);
+            }
+
+            double get(Field field) const
+            {
+                return value[field];
+            }
+
+            void set(Field field, double v)
+            {
+                value[field] = v;
+                present |= (1u << field);
+            }
+
+            double value[FIELD_COUNT] = {0};
+            uint32_t present { 0 };
+        };
+
+        /**
+         * @brief parse Decode the reply of a query into values.
+         * @param command Query as sent, e.g. ":GP#". Only its two letter code is looked up.
+         * @param reply Reply frame, e.g. "1234#".
+         * @return False if the command is not a known query or the reply is malformed, values
+         * are then left untouched.
+         */
+        static bool parse(const char * command, const char * reply, Values &values);
+
+        /**
+         * @brief parseEvent Decode an unsolicited event frame, e.g. "!P12345,1#". A move done
+         * frame ("!D12345#") also reports FIELD_MOVING as 0.
+         * @return False if the event type is unknown or the frame is malformed, values are then
+         * left untouched.
+         */
+        static bool parseEvent(const char * frame, Values &values);
+
+        /**
+         * @brief parseVersion Parse a major.minor.patch reply as major * 10000 + minor * 100 + patch.
+         * @return False if the reply does not start with a number.
+         */
+        static bool parseVersion(const char * reply, uint32_t &version);
+
+        /**
+         * @brief parseNumber Parse [+-]digits[.digits] at p and advance p past it.
+         * @return False if there are no digits.
+         */
+        static bool parseNumber(const char * &p, double &value);
+};
@@ -0,0 +1,87 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+    Run a simulated AstroStep controller, to point indi_astrostep at its serial port.
+
+    Usage: astrostep_sim [-b baud] [-l latency_us] [-j jitter_us] [-v version]
+*/
+
+#include "astrostep_simulator.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+static volatile sig_atomic_t quit = 0;
+
+static void onSignal(int)
+{
+    quit = 1;
+}
+
+int main(int argc, char * argv[])
+{
+    SimulatorConfig config;
+
+    int option = 0;
+    while ((option = getopt(argc, argv, "b:l:j:v:")) != -1)
+    {
+        switch (option)
+        {
+            case 'b':
+                config.baud = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'l':
+                config.latency = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'j':
+                config.jitter = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'v':
+                config.version = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-b baud] [-l latency_us] [-j jitter_us] [-v version]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    ControllerSimulator simulator(config);
+    if (!simulator.start())
+    {
+        perror("Failed to create the pseudo terminal");
+        return 1;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    printf("Simulated AstroStep %s on %s\n", config.version, simulator.devicePath());
+    fflush(stdout);
+
+    while (!quit)
+        pause();
+
+    simulator.stop();
+    return 0;
+}
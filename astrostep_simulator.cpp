@@ -0,0 +1,351 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_simulator.h"
+#include "astrostep_binary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+static void makeRaw(int fd)
+{
+    struct termios tty;
+    if (tcgetattr(fd, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+}
+
+ControllerSimulator::ControllerSimulator(const SimulatorConfig &config) : config(config), random(config.seed)
+{
+    speed = config.speed;
+    moveSpeed = speed;
+}
+
+ControllerSimulator::~ControllerSimulator()
+{
+    stop();
+}
+
+bool ControllerSimulator::start()
+{
+    stop();
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 || ptsname_r(master, path, sizeof(path)) != 0)
+    {
+        stop();
+        return false;
+    }
+
+    // Keep the slave open, otherwise the master reads EIO between clients.
+    slave = open(path, O_RDWR | O_NOCTTY);
+    if (slave < 0)
+    {
+        stop();
+        return false;
+    }
+    makeRaw(slave);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    rxBuffer.clear();
+    pending.clear();
+    lineFree = lastMove = lastStream = std::chrono::steady_clock::now();
+
+    running = true;
+    thread = std::thread(&ControllerSimulator::run, this);
+    return true;
+}
+
+void ControllerSimulator::stop()
+{
+    running = false;
+    if (thread.joinable())
+        thread.join();
+
+    if (slave >= 0)
+        close(slave);
+    if (master >= 0)
+        close(master);
+    slave = master = -1;
+}
+
+int ControllerSimulator::openClient() const
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd >= 0)
+        makeRaw(fd);
+    return fd;
+}
+
+std::chrono::microseconds ControllerSimulator::wireTime(size_t len) const
+{
+    return std::chrono::microseconds(static_cast<int64_t>(len) * 10 * 1000000 / std::max<uint32_t>(config.baud, 1));
+}
+
+void ControllerSimulator::run()
+{
+    char frame[64];
+
+    while (running)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        // Wake for the next reply, and often enough to move the motor smoothly.
+        int wait = 5;
+        if (!pending.empty())
+        {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(pending.front().due - now).count();
+            wait = std::max(0, std::min(wait, static_cast<int>(remaining)));
+        }
+
+        // The simulator holds the slave open, so the master never reports a hang up.
+        rxBuffer.fill(master, wait);
+
+        now = std::chrono::steady_clock::now();
+        // Binary frames start with the sync byte, anything else is an ASCII command.
+        while (rxBuffer.available() > 0)
+        {
+            size_t before = rxBuffer.available();
+            if (rxBuffer.peek(0) == BinaryProtocol::SYNC)
+            {
+                BinaryProtocol::Result result = BinaryProtocol::extract(rxBuffer, frame, sizeof(frame));
+                if (result == BinaryProtocol::FRAME_NONE)
+                    break;
+                binaryMode = true;
+                if (result == BinaryProtocol::FRAME_OK)
+                    handle(frame, before - rxBuffer.available(), now);
+                continue;
+            }
+
+            if (!rxBuffer.nextFrame(frame, sizeof(frame)))
+                break;
+            binaryMode = false;
+            handle(frame, strlen(frame), now);
+        }
+
+        move(now);
+        flush(now);
+    }
+}
+
+void ControllerSimulator::reply(const char * command, const char * text, TimePoint now)
+{
+    Output output;
+    output.length = 0;
+    if (binaryMode)
+        output.length = BinaryProtocol::encodeReply(command, text, reinterpret_cast<uint8_t *>(output.text),
+                        sizeof(output.text));
+    // Firmware replies go through Serial.println().
+    if (output.length == 0)
+        output.length = static_cast<size_t>(snprintf(output.text, sizeof(output.text), "%s\r\n", text));
+
+    std::uniform_int_distribution<uint32_t> extra(0, config.jitter);
+    output.due = now + std::chrono::microseconds(config.latency + extra(random));
+    pending.push_back(output);
+}
+
+void ControllerSimulator::flush(TimePoint now)
+{
+    while (!pending.empty() && pending.front().due <= now)
+    {
+        const Output &output = pending.front();
+        size_t len = output.length;
+
+        // One byte after the other on the wire, a reply cannot start before the previous one ended.
+        TimePoint start = std::max(lineFree, output.due);
+        lineFree = start + wireTime(len);
+        if (lineFree > now)
+            std::this_thread::sleep_until(lineFree);
+
+        ssize_t rc = write(master, output.text, len);
+        (void)rc;
+        pending.pop_front();
+    }
+}
+
+void ControllerSimulator::move(TimePoint now)
+{
+    double elapsed = std::chrono::duration<double>(now - lastMove).count();
+    lastMove = now;
+
+    if (timedMove && now >= timedMoveEnd)
+    {
+        timedMove = false;
+        target = static_cast<int32_t>(std::lround(position));
+    }
+
+    double distance = target - position;
+    bool moving = std::fabs(distance) > 0.5;
+    if (!moving)
+        velocity = 0;
+    else if (moveAcceleration > 0)
+    {
+        // Brake so the speed reaches zero at the target.
+        velocity = std::min(velocity + moveAcceleration * elapsed, moveSpeed);
+        velocity = std::min(velocity, std::sqrt(2 * moveAcceleration * std::fabs(distance)));
+    }
+    else
+        velocity = moveSpeed;
+
+    double step = velocity * elapsed;
+    if (moving)
+        position = (std::fabs(distance) <= step) ? target : position + (distance > 0 ? step : -step);
+
+    if (notifyDone && wasMoving && !moving)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "!D%ld#", std::lround(position));
+        reply(nullptr, text, now);
+    }
+
+    // Same stream as the firmware: on start, every interval while moving, once more when stopped.
+    if (streamInterval > 0)
+    {
+        bool due = now - lastStream >= std::chrono::milliseconds(streamInterval);
+        if ((moving && (due || !wasMoving)) || (wasMoving && !moving))
+        {
+            char text[32];
+            snprintf(text, sizeof(text), "!P%ld,%d#", std::lround(position), moving ? 1 : 0);
+            reply(nullptr, text, now);
+            lastStream = now;
+        }
+    }
+    wasMoving = moving;
+}
+
+void ControllerSimulator::startMove(int index)
+{
+    moveSpeed = (index > 0) ? profileSpeed[index] : speed;
+    moveAcceleration = (index > 0) ? profileAcceleration[index] : 0;
+}
+
+void ControllerSimulator::handle(const char * command, size_t length, TimePoint now)
+{
+    handled++;
+
+    // Time spent receiving the command before the controller can act on it.
+    now += wireTime(length);
+
+    if (command[0] != ':' || command[1] == '\0')
+        return;
+
+    const char * code = command + 1;
+    const char * argument = command + 3;
+    long value = atol(argument);
+    bool hasArgument = *argument != '#' && *argument != '\0';
+    bool moving = std::fabs(target - position) > 0.5;
+    char text[32] = {0};
+
+    if (code[0] == '+' || code[0] == '-')
+        return;
+
+    if (strncmp(code, "SN", 2) == 0)
+    {
+        target = static_cast<int32_t>(value);
+        timedMove = false;
+        startMove(profile);
+    }
+    else if (strncmp(code, "FG", 2) == 0)
+    {
+        if (hasArgument)
+            target = static_cast<int32_t>(value);
+        timedMove = false;
+        startMove(profile);
+    }
+    else if (strncmp(code, "FT", 2) == 0)
+    {
+        target = (*argument == '-') ? 0 : config.maxSteps;
+        startMove(0);
+        timedMove = true;
+        timedMoveEnd = now + std::chrono::milliseconds(atol(argument + 1));
+    }
+    else if (strncmp(code, "FQ", 2) == 0)
+    {
+        timedMove = false;
+        target = static_cast<int32_t>(std::lround(position));
+    }
+    else if (strncmp(code, "HO", 2) == 0)
+        target = 0;
+    else if (strncmp(code, "SP", 2) == 0)
+        position = target = static_cast<int32_t>(value);
+    else if (strncmp(code, "SD", 2) == 0)
+        speed = static_cast<uint32_t>(value);
+    else if (strncmp(code, "SY", 2) == 0)
+    {
+        unsigned int index = 0, steps = 0, acceleration = 0;
+        if (sscanf(argument, "%u,%u,%u", &index, &steps, &acceleration) == 3 && index > 0 && index < PROFILES)
+        {
+            profileSpeed[index] = steps;
+            profileAcceleration[index] = acceleration;
+        }
+    }
+    else if (strncmp(code, "SL", 2) == 0)
+    {
+        if (value >= 0 && value < PROFILES)
+            profile = static_cast<int>(value);
+    }
+    else if (strncmp(code, "SE", 2) == 0)
+        coilPower = static_cast<int>(value);
+    else if (strncmp(code, "SR", 2) == 0)
+        reverse = static_cast<int>(value);
+    else if (strncmp(code, "SO", 2) == 0)
+        calibration = static_cast<int>(value);
+    else if (strncmp(code, "SC", 2) == 0)
+        coefficient = static_cast<int>(value);
+    else if (strncmp(code, "SS", 2) == 0)
+        streamInterval = static_cast<uint32_t>(value);
+    else if (strncmp(code, "SF", 2) == 0)
+        notifyDone = value != 0;
+    else if (strncmp(code, "GV", 2) == 0)
+        snprintf(text, sizeof(text), "%s#", config.version);
+    else if (strncmp(code, "GP", 2) == 0)
+        snprintf(text, sizeof(text), "%ld#", std::lround(position));
+    else if (strncmp(code, "GI", 2) == 0)
+        snprintf(text, sizeof(text), "%d#", moving ? 1 : 0);
+    else if (strncmp(code, "GT", 2) == 0)
+        snprintf(text, sizeof(text), "20.00#");
+    else if (strncmp(code, "GD", 2) == 0)
+        snprintf(text, sizeof(text), "%u#", speed);
+    else if (strncmp(code, "GE", 2) == 0)
+        snprintf(text, sizeof(text), "%d#", coilPower);
+    else if (strncmp(code, "GR", 2) == 0)
+        snprintf(text, sizeof(text), "%d#", reverse);
+    else if (strncmp(code, "GO", 2) == 0)
+        snprintf(text, sizeof(text), "%d#", calibration);
+    else if (strncmp(code, "GC", 2) == 0)
+        snprintf(text, sizeof(text), "%d#", coefficient);
+    else if (strncmp(code, "GH", 2) == 0)
+        snprintf(text, sizeof(text), "32#");
+    else if (strncmp(code, "GS", 2) == 0)
+        snprintf(text, sizeof(text), "%ld,%d,20.00,%d#", std::lround(position), moving ? 1 : 0, coilPower);
+
+    if (text[0])
+        reply(command, text, now);
+}
@@ -0,0 +1,142 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include "astrostep_framebuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <thread>
+
+struct SimulatorConfig
+{
+    // Serial line speed, each byte costs ten bit times on the wire
+    uint32_t baud { 9600 };
+    // Controller processing time per command and its random extra, in microseconds
+    uint32_t latency { 1000 };
+    uint32_t jitter { 500 };
+    // Reported by :GV#, selects the protocol features the driver uses
+    const char * version { "0.8.0" };
+    // Motor speed in steps per second and travel
+    uint32_t speed { 800 };
+    int32_t maxSteps { 50000 };
+    uint32_t seed { 1 };
+};
+
+/**
+ * @brief The ControllerSimulator class emulates an AstroStep controller on a pseudo terminal.
+ *
+ * The driver, or any client, opens devicePath() like a serial port. Commands are answered
+ * the way the firmware does, with the configured processing latency and jitter, and the
+ * replies are paced at the configured baud rate. The motor moves at a constant speed, or
+ * accelerates and decelerates with a speed profile.
+ */
+class ControllerSimulator
+{
+    public:
+        explicit ControllerSimulator(const SimulatorConfig &config = SimulatorConfig());
+        ~ControllerSimulator();
+
+        bool start();
+        void stop();
+
+        // Slave side of the pseudo terminal
+        const char * devicePath() const
+        {
+            return path;
+        }
+
+        /**
+         * @brief openClient Open the slave side in raw mode for an in-process client.
+         * @return File descriptor, or -1 on error. The caller closes it.
+         */
+        int openClient() const;
+
+        // Commands handled so far
+        uint32_t commands() const
+        {
+            return handled;
+        }
+
+    private:
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+        struct Output
+        {
+            TimePoint due;
+            char text[40];
+            size_t length;
+        };
+
+        void run();
+        // Handle an ASCII command that took length bytes on the wire
+        void handle(const char * command, size_t length, TimePoint now);
+        // Queue a reply to command, or an event when command is nullptr
+        void reply(const char * command, const char * text, TimePoint now);
+        void move(TimePoint now);
+        // Speed and acceleration of the next move, as the firmware's startMove()
+        void startMove(int profile);
+        void flush(TimePoint now);
+        // Time needed to transmit len bytes at the configured baud rate
+        std::chrono::microseconds wireTime(size_t len) const;
+
+        SimulatorConfig config;
+        int master { -1 };
+        int slave { -1 };
+        char path[64] = {0};
+
+        std::thread thread;
+        std::atomic<bool> running { false };
+        std::atomic<uint32_t> handled { 0 };
+        std::mt19937 random;
+
+        // Only touched by the simulator thread.
+        FrameBuffer rxBuffer;
+        std::deque<Output> pending;
+        TimePoint lineFree;
+
+        double position { 0 };
+        int32_t target { 0 };
+        uint32_t speed { 0 };
+        // Profiles defined with :SY#, 0 is the :SD# speed without acceleration
+        static const int PROFILES { 4 };
+        uint32_t profileSpeed[PROFILES] = {0};
+        uint32_t profileAcceleration[PROFILES] = {0};
+        int profile { 0 };
+        // Current move
+        double moveSpeed { 0 };
+        double moveAcceleration { 0 };
+        double velocity { 0 };
+        int coilPower { 1 };
+        int reverse { 0 };
+        int calibration { 0 };
+        int coefficient { 0 };
+        // The last command was a binary frame, replies and events follow its framing
+        bool binaryMode { false };
+        uint32_t streamInterval { 0 };
+        bool notifyDone { false };
+        bool wasMoving { false };
+        TimePoint lastMove, lastStream, timedMoveEnd;
+        bool timedMove { false };
+};
@@ -0,0 +1,198 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "astrostep_stats.h"
+
+#include <cstdio>
+#include <cstring>
+
+const int LatencyHistogram::BUCKETS;
+const int CommandStats::MAX_CODES;
+const int TraceRing::MAX_RECORDS;
+const int TraceRing::MAX_LENGTH;
+
+int LatencyHistogram::bucket(uint32_t micros)
+{
+    if (micros < 4)
+        return static_cast<int>(micros);
+
+    int exponent = 31 - __builtin_clz(micros);
+    int sub = static_cast<int>((micros >> (exponent - 2)) & 3);
+    return 4 * (exponent - 1) + sub;
+}
+
+uint32_t LatencyHistogram::upperBound(int bucket)
+{
+    if (bucket < 4)
+        return static_cast<uint32_t>(bucket);
+
+    int exponent = bucket / 4 + 1;
+    int sub = bucket % 4;
+    uint64_t upper = (static_cast<uint64_t>(5 + sub) << (exponent - 2)) - 1;
+    return upper > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(upper);
+}
+
+void LatencyHistogram::add(uint32_t micros)
+{
+    counts[bucket(micros)]++;
+    total++;
+    if (micros > max)
+        max = micros;
+}
+
+void LatencyHistogram::clear()
+{
+    memset(counts, 0, sizeof(counts));
+    total = max = 0;
+}
+
+uint32_t LatencyHistogram::percentile(double fraction) const
+{
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(fraction * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            // Middle of the bucket, the largest sample bounds the last one.
+            uint32_t lower = (i == 0) ? 0 : upperBound(i - 1) + 1;
+            uint32_t middle = lower + (upperBound(i) - lower) / 2;
+            return middle < max ? middle : max;
+        }
+    }
+
+    return max;
+}
+
+CommandStats::Entry * CommandStats::find(const char * command)
+{
+    // Commands look like ":GP#", the code follows the ':'.
+    if (command == nullptr || command[0] != ':' || command[1] == '\0')
+        return nullptr;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (entries[i].code[0] == command[1] && entries[i].code[1] == command[2])
+            return &entries[i];
+    }
+
+    if (count == MAX_CODES)
+        return nullptr;
+
+    Entry * entry = &entries[count++];
+    *entry = Entry();
+    entry->code[0] = command[1];
+    entry->code[1] = (command[2] == '#') ? '\0' : command[2];
+    return entry;
+}
+
+void CommandStats::recordReply(const char * command, uint32_t micros)
+{
+    Entry * entry = find(command);
+    if (entry)
+        entry->latency.add(micros);
+}
+
+void CommandStats::recordTimeout(const char * command)
+{
+    Entry * entry = find(command);
+    if (entry)
+        entry->timeouts++;
+}
+
+void CommandStats::clear()
+{
+    count = 0;
+}
+
+uint32_t CommandStats::timeouts() const
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < count; i++)
+        sum += entries[i].timeouts;
+    return sum;
+}
+
+void CommandStats::summary(char * text, size_t len) const
+{
+    size_t used = 0;
+    text[0] = '\0';
+
+    for (int i = 0; i < count && used < len; i++)
+    {
+        const LatencyHistogram &latency = entries[i].latency;
+        int rc = snprintf(text + used, len - used, "%s%s %.1f/%.1f/%.1f ms x%u", used ? ", " : "", entries[i].code,
+                          latency.percentile(0.5) / 1000.0, latency.percentile(0.99) / 1000.0, latency.maximum() / 1000.0,
+                          latency.samples());
+        if (rc < 0)
+            break;
+        used += static_cast<size_t>(rc);
+    }
+}
+
+void TraceRing::add(double time, const char * command, const char * reply, uint32_t micros, int status)
+{
+    Record &record = records[next];
+    record.time = time;
+    strncpy(record.command, command, MAX_LENGTH - 1);
+    record.command[MAX_LENGTH - 1] = '\0';
+    strncpy(record.reply, reply ? reply : "", MAX_LENGTH - 1);
+    record.reply[MAX_LENGTH - 1] = '\0';
+    record.micros = micros;
+    record.status = status;
+
+    next = (next + 1) % MAX_RECORDS;
+    if (count < MAX_RECORDS)
+        count++;
+    dirty = true;
+}
+
+void TraceRing::clear()
+{
+    next = count = 0;
+    dirty = false;
+}
+
+bool TraceRing::write(const char * path)
+{
+    FILE * fp = fopen(path, "w");
+    if (fp == nullptr)
+        return false;
+
+    // One transaction per line: time command reply latency_us status
+    int first = (count < MAX_RECORDS) ? 0 : next;
+    for (int i = 0; i < count; i++)
+    {
+        const Record &record = records[(first + i) % MAX_RECORDS];
+        fprintf(fp, "%.6f %s %s %u %d\n", record.time, record.command, record.reply[0] ? record.reply : "-", record.micros,
+                record.status);
+    }
+
+    fclose(fp);
+    dirty = false;
+    return true;
+}
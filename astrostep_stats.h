@@ -0,0 +1,132 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The LatencyHistogram class counts latencies in logarithmic buckets.
+ *
+ * Each power of two is split in four buckets, so a percentile is exact to within about 12%.
+ * Recording is constant time and the histogram never allocates.
+ */
+class LatencyHistogram
+{
+    public:
+        static const int BUCKETS { 128 };
+
+        void add(uint32_t micros);
+        void clear();
+
+        // Middle of the bucket holding the given fraction (0 to 1) of the samples.
+        uint32_t percentile(double fraction) const;
+
+        uint32_t maximum() const
+        {
+            return max;
+        }
+
+        uint32_t samples() const
+        {
+            return total;
+        }
+
+    private:
+        static int bucket(uint32_t micros);
+        static uint32_t upperBound(int bucket);
+
+        uint32_t counts[BUCKETS] = {0};
+        uint32_t total { 0 };
+        uint32_t max { 0 };
+};
+
+/**
+ * @brief The CommandStats class keeps a latency histogram and a timeout counter per command code.
+ */
+class CommandStats
+{
+    public:
+        static const int MAX_CODES { 16 };
+
+        struct Entry
+        {
+            // Two letter command code, e.g. "GP"
+            char code[3] = {0};
+            LatencyHistogram latency;
+            uint32_t timeouts { 0 };
+        };
+
+        void recordReply(const char * command, uint32_t micros);
+        void recordTimeout(const char * command);
+        void clear();
+
+        uint32_t timeouts() const;
+
+        /**
+         * @brief summary Format "GP 1.2/3.4/5.6 ms x120" per code (p50/p99/max and samples).
+         */
+        void summary(char * text, size_t len) const;
+
+    private:
+        Entry * find(const char * command);
+
+        Entry entries[MAX_CODES];
+        int count { 0 };
+};
+
+/**
+ * @brief The TraceRing class keeps the last MAX_RECORDS transactions for a trace file.
+ */
+class TraceRing
+{
+    public:
+        static const int MAX_RECORDS { 512 };
+        static const int MAX_LENGTH { 32 };
+
+        // Seconds since the epoch of the steady clock, latency in microseconds, 0 if no reply.
+        void add(double time, const char * command, const char * reply, uint32_t micros, int status);
+        void clear();
+
+        // True if records were added since the last write().
+        bool changed() const
+        {
+            return dirty;
+        }
+
+        // Rewrite path with the records, oldest first.
+        bool write(const char * path);
+
+    private:
+        struct Record
+        {
+            double time { 0 };
+            char command[MAX_LENGTH] = {0};
+            char reply[MAX_LENGTH] = {0};
+            uint32_t micros { 0 };
+            int status { 0 };
+        };
+
+        Record records[MAX_RECORDS];
+        int next { 0 };
+        int count { 0 };
+        bool dirty { false };
+};
@@ -0,0 +1,201 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+#include "astrostep_telemetry.h"
+
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t TelemetryLog::VERSION;
+
+static const char MAGIC[8] = { 'A', 'S', 'T', 'E', 'L', 'E', 'M', 0 };
+
+// Columns start on a cache line
+static const size_t HEADER_SIZE { 64 };
+
+TelemetryLog::~TelemetryLog()
+{
+    close();
+}
+
+size_t TelemetryLog::fileSize(uint32_t capacity)
+{
+    return HEADER_SIZE + static_cast<size_t>(capacity) * (sizeof(int64_t) + 2 * sizeof(int32_t) + sizeof(float) +
+            sizeof(uint32_t) + 2 * sizeof(uint8_t));
+}
+
+bool TelemetryLog::create(const char * path, uint32_t capacity)
+{
+    close();
+    if (capacity == 0)
+        return false;
+
+    int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+
+    size_t size = fileSize(capacity);
+
+    // Keep the history of a ring of the same layout.
+    Header existing;
+    struct stat st;
+    bool reuse = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size &&
+                 pread(fd, &existing, sizeof(existing), 0) == static_cast<ssize_t>(sizeof(existing)) &&
+                 memcmp(existing.magic, MAGIC, sizeof(MAGIC)) == 0 && existing.version == VERSION && existing.capacity == capacity;
+
+    if (!reuse && (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(size)) != 0))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    bool rc = map(fd, capacity, true);
+    ::close(fd);
+    if (!rc)
+        return false;
+
+    if (!reuse)
+    {
+        memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        header->version = VERSION;
+        header->capacity = capacity;
+        header->written = 0;
+    }
+
+    return true;
+}
+
+bool TelemetryLog::open(const char * path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    Header existing;
+    struct stat st;
+    bool valid = fstat(fd, &st) == 0 && pread(fd, &existing, sizeof(existing), 0) == static_cast<ssize_t>(sizeof(existing)) &&
+                 memcmp(existing.magic, MAGIC, sizeof(MAGIC)) == 0 && existing.version == VERSION && existing.capacity > 0 &&
+                 static_cast<size_t>(st.st_size) == fileSize(existing.capacity);
+
+    bool rc = valid && map(fd, existing.capacity, false);
+    ::close(fd);
+    return rc;
+}
+
+bool TelemetryLog::map(int fd, uint32_t entries, bool writable)
+{
+    size_t size = fileSize(entries);
+    void * base = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return false;
+
+    header = static_cast<Header *>(base);
+    mapped = size;
+
+    uint8_t * column = static_cast<uint8_t *>(base) + HEADER_SIZE;
+    time = reinterpret_cast<int64_t *>(column);
+    column += entries * sizeof(int64_t);
+    position = reinterpret_cast<int32_t *>(column);
+    column += entries * sizeof(int32_t);
+    target = reinterpret_cast<int32_t *>(column);
+    column += entries * sizeof(int32_t);
+    temperature = reinterpret_cast<float *>(column);
+    column += entries * sizeof(float);
+    latency = reinterpret_cast<uint32_t *>(column);
+    column += entries * sizeof(uint32_t);
+    moving = column;
+    column += entries;
+    filter = column;
+    return true;
+}
+
+void TelemetryLog::close()
+{
+    if (header == nullptr)
+        return;
+
+    munmap(header, mapped);
+    header = nullptr;
+    mapped = 0;
+}
+
+void TelemetryLog::record(Sample sample)
+{
+    if (header == nullptr)
+        return;
+
+    if (sample.time == 0)
+        sample.time = std::chrono::duration_cast<std::chrono::microseconds>
+                      (std::chrono::system_clock::now().time_since_epoch()).count();
+
+    uint64_t sequence = header->written;
+    uint32_t index = static_cast<uint32_t>(sequence % header->capacity);
+    time[index] = sample.time;
+    position[index] = sample.position;
+    target[index] = sample.target;
+    temperature[index] = sample.temperature;
+    latency[index] = sample.latency;
+    moving[index] = sample.moving;
+    filter[index] = sample.filter;
+
+    // Publish the sample only once its columns are written.
+    __atomic_store_n(&header->written, sequence + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t TelemetryLog::written() const
+{
+    return header ? __atomic_load_n(&header->written, __ATOMIC_ACQUIRE) : 0;
+}
+
+uint32_t TelemetryLog::capacity() const
+{
+    return header ? header->capacity : 0;
+}
+
+uint64_t TelemetryLog::oldest() const
+{
+    uint64_t count = written();
+    uint32_t size = capacity();
+    return (count < size) ? 0 : count - size + 1;
+}
+
+bool TelemetryLog::get(uint64_t sequence, Sample &sample) const
+{
+    if (header == nullptr || sequence < oldest() || sequence >= written())
+        return false;
+
+    uint32_t index = static_cast<uint32_t>(sequence % header->capacity);
+    sample.time = time[index];
+    sample.position = position[index];
+    sample.target = target[index];
+    sample.temperature = temperature[index];
+    sample.latency = latency[index];
+    sample.moving = moving[index];
+    sample.filter = filter[index];
+    return true;
+}
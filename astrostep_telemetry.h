@@ -0,0 +1,119 @@
+/*
+    AstroStep Focuser
+    Copyright (C) 2013-2019 Jasem Mutlaq (mutlaqja@ikarustech.com)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The TelemetryLog class keeps a history of samples in a fixed size memory mapped ring file.
+ *
+ * The file holds a header and one column per field, each CAPACITY entries long, so a sample
+ * is a handful of stores into the mapping: no allocation and no system call. The kernel
+ * writes the pages back on its own, and the file survives the driver. Once full, the
+ * oldest samples are overwritten.
+ *
+ * The same class opens a file read only for the export tool.
+ */
+class TelemetryLog
+{
+    public:
+        static const uint32_t VERSION { 1 };
+
+        struct Sample
+        {
+            // Microseconds since the epoch
+            int64_t time { 0 };
+            int32_t position { 0 };
+            int32_t target { 0 };
+            // Celsius
+            float temperature { 0 };
+            // Reply latency of the command that produced the sample, 0 if none
+            uint32_t latency { 0 };
+            uint8_t moving { 0 };
+            // Zero based filter slot of the compensation
+            uint8_t filter { 0 };
+        };
+
+        TelemetryLog() = default;
+        ~TelemetryLog();
+
+        TelemetryLog(const TelemetryLog &) = delete;
+        TelemetryLog &operator=(const TelemetryLog &) = delete;
+
+        /**
+         * @brief create Map path for writing. An existing ring of the same capacity is appended
+         * to, any other file is replaced by an empty ring.
+         */
+        bool create(const char * path, uint32_t capacity);
+
+        // Map path read only.
+        bool open(const char * path);
+
+        void close();
+
+        bool isOpen() const
+        {
+            return header != nullptr;
+        }
+
+        // Store a sample, stamped now if its time is 0.
+        void record(Sample sample);
+
+        // Samples recorded since the ring was created, including those overwritten.
+        uint64_t written() const;
+
+        uint32_t capacity() const;
+
+        /**
+         * @brief oldest Sequence number of the oldest sample that can be read.
+         * With a live writer the slot about to be overwritten is skipped.
+         */
+        uint64_t oldest() const;
+
+        // Copy sample number sequence, false if it was overwritten or not written yet.
+        bool get(uint64_t sequence, Sample &sample) const;
+
+    private:
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t capacity;
+            uint64_t written;
+        };
+
+        static size_t fileSize(uint32_t capacity);
+        bool map(int fd, uint32_t entries, bool writable);
+
+        Header * header { nullptr };
+        size_t mapped { 0 };
+
+        // Columns, in order of decreasing alignment
+        int64_t * time { nullptr };
+        int32_t * position { nullptr };
+        int32_t * target { nullptr };
+        float * temperature { nullptr };
+        uint32_t * latency { nullptr };
+        uint8_t * moving { nullptr };
+        uint8_t * filter { nullptr };
+};
@@ -12,11 +12,54 @@
 #define M2 6
 #define motorInterfaceType 1
 
-char version[] = "0.0.1";
+char version[] = "0.8.0";
 int speed = 800;
 long maxSteps = 50000;
 int stepMode = 32;
-char buffSend[15];
+int coilPower = 1;
+int reverse = 0;
+int tempCalibration = 0;
+int tempCoefficient = 0;
+char buffSend[32];
+// Incoming command, accumulated until the '#' terminator.
+char buffRecv[32];
+unsigned int recvLen = 0;
+// End of the current timed move in milliseconds, 0 when none is running.
+unsigned long timedMoveEnd = 0;
+// Position stream interval in milliseconds while moving, 0 when disabled.
+unsigned int streamInterval = 0;
+unsigned long lastStream = 0;
+// Send a move done frame when a motion ends.
+int notifyDone = 0;
+bool wasRunning = false;
+// Speed profiles defined with SY and selected with SL for the next moves. Profile 0 is the SD
+// speed without acceleration, timed moves always use it.
+const int PROFILES = 4;
+long profileSpeed[PROFILES] = {0};
+long profileAccel[PROFILES] = {0};
+int profile = 0;
+// The current move accelerates, run() steps it instead of runSpeedToPosition().
+bool accelerated = false;
+// Binary framing: sync, payload length, payload, CRC-16/CCITT of length and payload, low byte first.
+// A payload is an opcode and fixed width little endian fields. Replies carry the opcode of their
+// query plus 0x40. The last command received selects the framing of replies and events.
+const byte BIN_SYNC = 0xA5;
+const byte BIN_REPLY = 0x40;
+const byte BIN_MAX_PAYLOAD = 16;
+byte binRecv[BIN_MAX_PAYLOAD + 4];
+unsigned int binLen = 0;
+byte binSend[BIN_MAX_PAYLOAD];
+byte binSendLen = 0;
+byte binOpcode = 0;
+bool binaryMode = false;
+// Opcode of each command, in the order of binCodes. 'A' marks a 32 bit argument, 'O' an optional
+// one and 'T' the signed duration of a timed move.
+const byte binOpcodes[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+                            0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+                            0x30 };
+const char * binCodes[] = { "GV", "GP", "GI", "GT", "GD", "GE", "GR", "GO", "GC", "GS", "GH",
+                            "SN", "FG", "FT", "FQ", "SP", "SD", "SM", "SE", "SR", "SO", "SC", "SS", "SF", "HO", "+", "-", "SL" };
+const char binArguments[] = "-----------AOT-AAAAAAAAA---A";
 // Create a new instance of the AccelStepper class:
 AccelStepper focuser = AccelStepper(motorInterfaceType, stepPin, dirPin);
 
@@ -33,23 +76,166 @@ void setup() {
 }
 
 void focuserComm(){
-  if (Serial.available() > 0) {
-    String strInput = Serial.readString();
-    focuserProtocol(strInput);
+  // Several commands may arrive back to back, handle each one on its terminator.
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    // A sync byte outside an ASCII command starts a binary frame.
+    if (binLen > 0 || (recvLen == 0 && (byte)c == BIN_SYNC)) {
+      binaryReceive((byte)c);
+      continue;
+    }
+    if (c == ':') {
+      recvLen = 0;
+    }
+    if (recvLen < sizeof(buffRecv) - 1) {
+      buffRecv[recvLen++] = c;
+    }
+    if (c == '#') {
+      buffRecv[recvLen] = '\0';
+      binaryMode = false;
+      focuserProtocol(String(buffRecv));
+      recvLen = 0;
+    }
+  }
+}
+
+
+
+uint16_t crc16(uint16_t crc, byte data){
+  crc ^= (uint16_t)data << 8;
+  for (byte bit = 0; bit < 8; bit++){
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+void binaryReceive(byte b){
+  binRecv[binLen++] = b;
+  if (binLen < 2){
+    return;
+  }
+  byte len = binRecv[1];
+  if (len == 0 || len > BIN_MAX_PAYLOAD){
+    binLen = 0;
+    return;
+  }
+  if (binLen < (unsigned int)len + 4){
+    return;
+  }
+  binLen = 0;
+
+  uint16_t crc = 0xFFFF;
+  for (byte i = 1; i < len + 2; i++){
+    crc = crc16(crc, binRecv[i]);
+  }
+  if (binRecv[len + 2] != (crc & 0xFF) || binRecv[len + 3] != (crc >> 8)){
+    return;
+  }
+
+  // Rebuild the ASCII command and run it through the same parser.
+  for (byte i = 0; i < sizeof(binOpcodes); i++){
+    if (binOpcodes[i] != binRecv[2]){
+      continue;
+    }
+    long value = 0;
+    for (byte j = 0; j < 4 && j + 1 < len; j++){
+      value |= (long)binRecv[3 + j] << (8 * j);
+    }
+    if (binArguments[i] == 'T'){
+      sprintf(buffRecv, ":%s%c%05ld#", binCodes[i], value < 0 ? '-' : '+', value < 0 ? -value : value);
+    }
+    else if (binArguments[i] == 'A' || (binArguments[i] == 'O' && len > 1)){
+      sprintf(buffRecv, ":%s%ld#", binCodes[i], value);
+    }
+    else {
+      sprintf(buffRecv, ":%s#", binCodes[i]);
+    }
+    binaryMode = true;
+    binOpcode = binRecv[2];
+    focuserProtocol(String(buffRecv));
+    return;
   }
 }
 
+void binaryBegin(byte opcode){
+  binSendLen = 0;
+  binSend[binSendLen++] = opcode;
+}
 
+void binaryPut(long value, byte size){
+  for (byte i = 0; i < size; i++){
+    binSend[binSendLen++] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+void binarySend(){
+  uint16_t crc = crc16(0xFFFF, binSendLen);
+  for (byte i = 0; i < binSendLen; i++){
+    crc = crc16(crc, binSend[i]);
+  }
+  Serial.write(BIN_SYNC);
+  Serial.write(binSendLen);
+  Serial.write(binSend, binSendLen);
+  Serial.write(crc & 0xFF);
+  Serial.write(crc >> 8);
+}
+
+// Reply with a single number, size is its width in binary frames.
+void replyNumber(long value, byte size){
+  if (binaryMode){
+    binaryBegin(binOpcode | BIN_REPLY);
+    binaryPut(value, size);
+    binarySend();
+    return;
+  }
+  sprintf(buffSend, "%ld#", value);
+  Serial.println(buffSend);
+}
+
+// Set up the next move for profile p.
+void startMove(int p){
+  long moveSpeed = (p > 0) ? profileSpeed[p] : speed;
+  accelerated = p > 0 && profileAccel[p] > 0;
+  if (accelerated){
+    focuser.setMaxSpeed(moveSpeed);
+    focuser.setAcceleration(profileAccel[p]);
+  }
+  else {
+    focuser.setMaxSpeed(12800);
+    focuser.setSpeed(moveSpeed);
+  }
+}
 
 void focuserProtocol(String strInput){
-  // Set new position
+  // Set new position. A goto replaces a timed move, whose end must not stop it.
   if (strInput.substring(1, 3) == "SN"){
     long ticks = strInput.substring(3, strInput.indexOf('#')).toFloat();
+    timedMoveEnd = 0;
     focuser.moveTo(ticks);
-    focuser.setSpeed(speed);
+    startMove(profile);
+  }
+  // Go to position, either the one given with the command or the last one set with SN.
+  if (strInput.substring(1, 3) == "FG"){
+    if (strInput.indexOf('#') > 3){
+      long ticks = strInput.substring(3, strInput.indexOf('#')).toFloat();
+      focuser.moveTo(ticks);
+    }
+    timedMoveEnd = 0;
+    startMove(profile);
+  }
+  // Timed move: direction sign followed by the duration in milliseconds.
+  if (strInput.substring(1, 3) == "FT"){
+    unsigned long duration = strInput.substring(4, strInput.indexOf('#')).toInt();
+    focuser.moveTo(strInput.charAt(3) == '-' ? 0 : maxSteps);
+    startMove(0);
+    timedMoveEnd = millis() + duration;
+    if (timedMoveEnd == 0){
+      timedMoveEnd = 1;
+    }
   }
   // Abort focuser
   if (strInput.substring(1, 3) == "FQ"){
+    timedMoveEnd = 0;
     focuser.stop();
   }
   // Sync focuser
@@ -61,6 +247,23 @@ void focuserProtocol(String strInput){
   if (strInput.substring(1, 3) == "SD"){
     speed = long(strInput.substring(3, strInput.indexOf('#')).toFloat());
   }
+  // Define a speed profile: number, speed in steps per second, acceleration in steps per second squared.
+  if (strInput.substring(1, 3) == "SY"){
+    int first = strInput.indexOf(',');
+    int second = strInput.indexOf(',', first + 1);
+    int p = strInput.substring(3, first).toInt();
+    if (first > 3 && second > first && p > 0 && p < PROFILES){
+      profileSpeed[p] = strInput.substring(first + 1, second).toInt();
+      profileAccel[p] = strInput.substring(second + 1, strInput.indexOf('#')).toInt();
+    }
+  }
+  // Select the speed profile of the next moves.
+  if (strInput.substring(1, 3) == "SL"){
+    int p = strInput.substring(3, strInput.indexOf('#')).toInt();
+    if (p >= 0 && p < PROFILES){
+      profile = p;
+    }
+  }
   // Set step mode.
   if (strInput.substring(1, 3) == "SM"){
     stepMode = strInput.substring(3, strInput.indexOf('#')).toFloat();
@@ -95,30 +298,86 @@ void focuserProtocol(String strInput){
       digitalWrite(M2, HIGH);
     }
   }
+  // Set coil power.
+  if (strInput.substring(1, 3) == "SE"){
+    coilPower = strInput.substring(3, strInput.indexOf('#')).toInt();
+  }
+  // Set reverse direction.
+  if (strInput.substring(1, 3) == "SR"){
+    reverse = strInput.substring(3, strInput.indexOf('#')).toInt();
+  }
+  // Set temperature calibration.
+  if (strInput.substring(1, 3) == "SO"){
+    tempCalibration = strInput.substring(3, strInput.indexOf('#')).toInt();
+  }
+  // Set temperature coefficient.
+  if (strInput.substring(1, 3) == "SC"){
+    tempCoefficient = strInput.substring(3, strInput.indexOf('#')).toInt();
+  }
+  // Set position stream interval, 0 disables it.
+  if (strInput.substring(1, 3) == "SS"){
+    streamInterval = strInput.substring(3, strInput.indexOf('#')).toInt();
+  }
+  // Enable the move done frame.
+  if (strInput.substring(1, 3) == "SF"){
+    notifyDone = strInput.substring(3, strInput.indexOf('#')).toInt();
+  }
+  // Get coil power.
+  if (strInput.substring(1, 3) == "GE"){
+    replyNumber(coilPower, 1);
+  }
+  // Get reverse direction.
+  if (strInput.substring(1, 3) == "GR"){
+    replyNumber(reverse, 1);
+  }
+  // Get temperature calibration.
+  if (strInput.substring(1, 3) == "GO"){
+    replyNumber(tempCalibration, 4);
+  }
+  // Get temperature coefficient.
+  if (strInput.substring(1, 3) == "GC"){
+    replyNumber(tempCoefficient, 4);
+  }
   // Get position.
   if (strInput.substring(1, 3) == "GP"){
-    sprintf(buffSend, "%d#", focuser.currentPosition());
-    Serial.println(buffSend);
+    replyNumber(focuser.currentPosition(), 4);
   }
   // Get stepMode.
   if (strInput.substring(1, 3) == "GH"){
-    sprintf(buffSend, "%d#", stepMode);
-    Serial.println(buffSend);
+    replyNumber(stepMode, 4);
   }
   // Get speed.
   if (strInput.substring(1, 3) == "GD"){
-    sprintf(buffSend, "%d#", speed);
-    Serial.println(buffSend);
+    replyNumber(speed, 4);
   }
   // Get version.
   if (strInput.substring(1, 3) == "GV"){
+    if (binaryMode){
+      int major = 0, minor = 0, patch = 0;
+      sscanf(version, "%d.%d.%d", &major, &minor, &patch);
+      binaryBegin(binOpcode | BIN_REPLY);
+      binaryPut(major, 1);
+      binaryPut(minor, 1);
+      binaryPut(patch, 1);
+      binarySend();
+      return;
+    }
     sprintf(buffSend, "%s#", version);
     Serial.println(buffSend);
   }
   // Get temperature.
   if (strInput.substring(1, 3) == "GT"){
     float temperature = 20.0;
-    sprintf(buffSend, "%lf#", temperature);
+    if (binaryMode){
+      binaryBegin(binOpcode | BIN_REPLY);
+      binaryPut(lround(temperature * 100), 2);
+      binarySend();
+      return;
+    }
+    char buffTemp[10];
+    // avr-libc sprintf has no floating point support.
+    dtostrf(temperature, 1, 2, buffTemp);
+    sprintf(buffSend, "%s#", buffTemp);
     Serial.println(buffSend);
   }
   // Is focuser moving ?
@@ -130,15 +389,77 @@ void focuserProtocol(String strInput){
     else if (focuser.isRunning() == false){
       isMoving = 0;
     }
-    sprintf(buffSend, "%d#", isMoving);
+    replyNumber(isMoving, 1);
+  }
+  // Get combined status: position, moving, temperature, coil power.
+  if (strInput.substring(1, 3) == "GS"){
+    float temperature = 20.0;
+    if (binaryMode){
+      binaryBegin(binOpcode | BIN_REPLY);
+      binaryPut(focuser.currentPosition(), 4);
+      binaryPut(focuser.isRunning() ? 1 : 0, 1);
+      binaryPut(lround(temperature * 100), 2);
+      binaryPut(coilPower, 1);
+      binarySend();
+      return;
+    }
+    char buffTemp[10];
+    dtostrf(temperature, 1, 2, buffTemp);
+    sprintf(buffSend, "%ld,%d,%s,%d#", focuser.currentPosition(), focuser.isRunning() ? 1 : 0, buffTemp, coilPower);
     Serial.println(buffSend);
   }
 }
 
 void loop() {
   focuserComm();
-  if (focuser.targetPosition() == focuser.currentPosition()){
-    focuser.setSpeed(0);
+  // Stop a timed move right where it is.
+  if (timedMoveEnd != 0 && (long)(millis() - timedMoveEnd) >= 0){
+    timedMoveEnd = 0;
+    focuser.moveTo(focuser.currentPosition());
+  }
+  if (accelerated){
+    focuser.run();
+  }
+  else {
+    if (focuser.targetPosition() == focuser.currentPosition()){
+      focuser.setSpeed(0);
+    }
+    focuser.runSpeedToPosition();
+  }
+  focuserStream();
+}
+
+void focuserStream(){
+  bool running = focuser.isRunning();
+  // Tell the host the motion ended, with the final position.
+  if (notifyDone != 0 && wasRunning && !running){
+    if (binaryMode){
+      binaryBegin(0x81);
+      binaryPut(focuser.currentPosition(), 4);
+      binarySend();
+    }
+    else {
+      sprintf(buffSend, "!D%ld#", focuser.currentPosition());
+      Serial.println(buffSend);
+    }
+  }
+  // Push the position when a motion starts, while moving, and once more when it ends.
+  if (streamInterval == 0){
+    wasRunning = running;
+    return;
+  }
+  if ((running && (!wasRunning || millis() - lastStream >= streamInterval)) || (wasRunning && !running)){
+    lastStream = millis();
+    if (binaryMode){
+      binaryBegin(0x80);
+      binaryPut(focuser.currentPosition(), 4);
+      binaryPut(running ? 1 : 0, 1);
+      binarySend();
+    }
+    else {
+      sprintf(buffSend, "!P%ld,%d#", focuser.currentPosition(), running ? 1 : 0);
+      Serial.println(buffSend);
+    }
   }
-  focuser.runSpeedToPosition();
+  wasRunning = running;
 }
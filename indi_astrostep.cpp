@@ -22,14 +22,47 @@
 
 #include "indicom.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <vector>
 
-#include <termios.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
-static std::unique_ptr<AstroStep> astrostep(new AstroStep());
+// Focusers hosted by this process, each on its own port, all sharing the I/O thread.
+static const int MAX_FOCUSERS = 8;
+
+static std::vector<std::unique_ptr<AstroStep>> createFocusers()
+{
+    const char * count = getenv("ASTROSTEP_FOCUSERS");
+    int focusers = count ? std::max(1, std::min(atoi(count), MAX_FOCUSERS)) : 1;
+
+    std::vector<std::unique_ptr<AstroStep>> instances;
+    for (int i = 0; i < focusers; i++)
+    {
+        instances.emplace_back(new AstroStep());
+        if (i > 0)
+        {
+            char name[MAXINDIDEVICE] = {0};
+            snprintf(name, MAXINDIDEVICE, "%s %d", instances[i]->getDefaultName(), i + 1);
+            instances[i]->setDeviceName(name);
+        }
+    }
+
+    return instances;
+}
+
+static std::vector<std::unique_ptr<AstroStep>> astrostep = createFocusers();
+
+static const char * COMPENSATION_TAB = "Compensation";
+static const char * DIAGNOSTICS_TAB = "Diagnostics";
+static const char * SWEEP_TAB = "Focus Sweep";
 
 AstroStep::AstroStep()
 {
@@ -37,10 +70,22 @@ AstroStep::AstroStep()
 
     // Can move in Absolute & Relative motions, can AbortFocuser motion, and has variable speed.
     FI::SetCapability(FOCUSER_CAN_ABS_MOVE | FOCUSER_CAN_REL_MOVE | FOCUSER_CAN_ABORT | FOCUSER_CAN_REVERSE |
-                    FOCUSER_HAS_VARIABLE_SPEED | FOCUSER_CAN_SYNC);
+                    FOCUSER_HAS_VARIABLE_SPEED | FOCUSER_CAN_SYNC | FOCUSER_HAS_BACKLASH);
     setSupportedConnections(CONNECTION_SERIAL | CONNECTION_TCP);
 }
 
+AstroStep::~AstroStep()
+{
+    stopReconnect();
+    if (reconnectCallbackID >= 0)
+        IERmCallback(reconnectCallbackID);
+    for (int fd : reconnectPipe)
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
 bool AstroStep::initProperties()
 {
     INDI::Focuser::initProperties();
@@ -88,26 +133,247 @@ bool AstroStep::initProperties()
     FocusAbsPosN[0].value = 0;
     FocusAbsPosN[0].step  = 100;
 
-    setDefaultPollingPeriod(500);
+    // Temperature filter
+    IUFillSwitch(&TemperatureFilterS[FILTER_NONE], "FILTER_NONE", "None", ISS_OFF);
+    IUFillSwitch(&TemperatureFilterS[FILTER_EXPONENTIAL], "FILTER_EXPONENTIAL", "Exponential", ISS_ON);
+    IUFillSwitch(&TemperatureFilterS[FILTER_MEDIAN], "FILTER_MEDIAN", "Median", ISS_OFF);
+    IUFillSwitchVector(&TemperatureFilterSP, TemperatureFilterS, 3, getDeviceName(), "FOCUS_TEMPERATURE_FILTER", "T. Filter",
+                       OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&TemperatureFilterN[FILTER_ALPHA], "FILTER_ALPHA", "Smoothing", "%.2f", 0.05, 1, 0.05, 0.3);
+    IUFillNumber(&TemperatureFilterN[FILTER_WINDOW], "FILTER_WINDOW", "Median samples", "%.f", 1, ML_TEMPERATURE_WINDOW, 2, 5);
+    IUFillNumberVector(&TemperatureFilterNP, TemperatureFilterN, 2, getDeviceName(), "FOCUS_TEMPERATURE_FILTER_SETTINGS",
+                       "T. Filter Settings", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Show the last known parameters while connecting
+    IUFillSwitch(&FastConnectS[INDI_ENABLED], "INDI_ENABLED", "Enable", ISS_OFF);
+    IUFillSwitch(&FastConnectS[INDI_DISABLED], "INDI_DISABLED", "Disable", ISS_ON);
+    IUFillSwitchVector(&FastConnectSP, FastConnectS, 2, getDeviceName(), "FOCUS_FAST_CONNECT", "Fast Connect", OPTIONS_TAB,
+                       IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    // Compact CRC checked framing, negotiated on connect
+    IUFillSwitch(&BinaryProtocolS[INDI_ENABLED], "INDI_ENABLED", "Enable", ISS_ON);
+    IUFillSwitch(&BinaryProtocolS[INDI_DISABLED], "INDI_DISABLED", "Disable", ISS_OFF);
+    IUFillSwitchVector(&BinaryProtocolSP, BinaryProtocolS, 2, getDeviceName(), "FOCUS_BINARY_PROTOCOL", "Binary Protocol",
+                       OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillSwitch(&AutoReconnectS[INDI_ENABLED], "INDI_ENABLED", "Enable", ISS_ON);
+    IUFillSwitch(&AutoReconnectS[INDI_DISABLED], "INDI_DISABLED", "Disable", ISS_OFF);
+    IUFillSwitchVector(&AutoReconnectSP, AutoReconnectS, 2, getDeviceName(), "FOCUS_AUTO_RECONNECT", "Auto Reconnect",
+                       OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    // Position pushed by the controller while moving
+    IUFillNumber(&StreamN[0], "STREAM_INTERVAL", "Interval (ms)", "%.f", 0, 5000, 10, 0);
+    IUFillNumberVector(&StreamNP, StreamN, 1, getDeviceName(), "FOCUS_STREAM", "Position stream", OPTIONS_TAB, IP_RW, 0,
+                       IPS_IDLE);
+
+    // Value updates sent to the clients are coalesced up to this rate
+    IUFillNumber(&PublishRateN[0], "PUBLISH_RATE", "Max rate (Hz)", "%.f", 1, 50, 1, 10);
+    IUFillNumberVector(&PublishRateNP, PublishRateN, 1, getDeviceName(), "FOCUS_PUBLISH_RATE", "Updates", OPTIONS_TAB, IP_RW, 0,
+                       IPS_IDLE);
+
+    // Moves shorter than the deadband are skipped
+    IUFillNumber(&MotionDeadbandN[0], "DEADBAND", "Steps", "%.f", 0, 1000, 1, 0);
+    IUFillNumberVector(&MotionDeadbandNP, MotionDeadbandN, 1, getDeviceName(), "FOCUS_DEADBAND", "Deadband", OPTIONS_TAB, IP_RW,
+                       0, IPS_IDLE);
+
+    // Moves at least the slew distance long run the slew profile, shorter ones and backlash approaches the approach profile
+    IUFillSwitch(&SpeedProfileS[INDI_ENABLED], "INDI_ENABLED", "Enable", ISS_ON);
+    IUFillSwitch(&SpeedProfileS[INDI_DISABLED], "INDI_DISABLED", "Disable", ISS_OFF);
+    IUFillSwitchVector(&SpeedProfileSP, SpeedProfileS, 2, getDeviceName(), "FOCUS_SPEED_PROFILE", "Speed profiles", OPTIONS_TAB,
+                       IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&SpeedProfileN[PROFILE_SLEW_SPEED], "PROFILE_SLEW_SPEED", "Slew (steps/s)", "%.f", 1, ML_MAX_SPEED, 100, 3200);
+    IUFillNumber(&SpeedProfileN[PROFILE_SLEW_ACCELERATION], "PROFILE_SLEW_ACCELERATION", "Slew accel. (steps/s^2)", "%.f", 0,
+                 1e6, 100, 4000);
+    IUFillNumber(&SpeedProfileN[PROFILE_APPROACH_SPEED], "PROFILE_APPROACH_SPEED", "Approach (steps/s)", "%.f", 1, ML_MAX_SPEED,
+                 50, 800);
+    IUFillNumber(&SpeedProfileN[PROFILE_APPROACH_ACCELERATION], "PROFILE_APPROACH_ACCELERATION", "Approach accel. (steps/s^2)",
+                 "%.f", 0, 1e6, 100, 16000);
+    IUFillNumber(&SpeedProfileN[PROFILE_DISTANCE], "PROFILE_DISTANCE", "Slew from (steps)", "%.f", 1, 1e6, 100, 500);
+    IUFillNumberVector(&SpeedProfileNP, SpeedProfileN, 5, getDeviceName(), "FOCUS_SPEED_PROFILES", "Profiles", OPTIONS_TAB,
+                       IP_RW, 0, IPS_IDLE);
+
+    // Positions interpolated from the speed between polls, 0 ms disables them
+    IUFillNumber(&PredictionN[PREDICT_INTERVAL], "PREDICT_INTERVAL", "Interval (ms)", "%.f", 0, 1000, 10, 100);
+    IUFillNumber(&PredictionN[PREDICT_ACCELERATION], "PREDICT_ACCELERATION", "Acceleration (steps/s^2)", "%.f", 0, 1e6, 100, 0);
+    IUFillNumberVector(&PredictionNP, PredictionN, 2, getDeviceName(), "FOCUS_PREDICTION", "Prediction", OPTIONS_TAB, IP_RW,
+                       0, IPS_IDLE);
+
+    // Focus sweep, setting it starts the run. With no dwell, each step waits for SWEEP_NEXT.
+    IUFillNumber(&FocusSweepN[SWEEP_START], "SWEEP_START", "Start", "%.f", 0, 1e7, 100, 0);
+    IUFillNumber(&FocusSweepN[SWEEP_STEP], "SWEEP_STEP", "Step", "%.f", -1e6, 1e6, 10, 100);
+    IUFillNumber(&FocusSweepN[SWEEP_COUNT], "SWEEP_COUNT", "Steps", "%.f", 1, ML_SWEEP_MAX, 1, 9);
+    IUFillNumber(&FocusSweepN[SWEEP_SETTLE], "SWEEP_SETTLE", "Settle (ms)", "%.f", 0, 10000, 10, 0);
+    IUFillNumber(&FocusSweepN[SWEEP_DWELL], "SWEEP_DWELL", "Dwell (ms)", "%.f", 0, 3600000, 100, 0);
+    IUFillNumberVector(&FocusSweepNP, FocusSweepN, 5, getDeviceName(), "FOCUS_SWEEP", "Sweep", SWEEP_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Ready signal: state turns OK with the step and the time it settled, BUSY while moving
+    IUFillNumber(&SweepStatusN[SWEEP_INDEX], "SWEEP_INDEX", "Step", "%.f", 0, ML_SWEEP_MAX, 0, 0);
+    IUFillNumber(&SweepStatusN[SWEEP_POSITION], "SWEEP_POSITION", "Position", "%.f", 0, 1e7, 0, 0);
+    IUFillNumber(&SweepStatusN[SWEEP_READY_TIME], "SWEEP_READY_TIME", "Ready (s since epoch)", "%.3f", 0, 1e10, 0, 0);
+    IUFillNumberVector(&SweepStatusNP, SweepStatusN, 3, getDeviceName(), "FOCUS_SWEEP_STATUS", "Step", SWEEP_TAB, IP_RO, 0,
+                       IPS_IDLE);
+
+    IUFillSwitch(&SweepControlS[SWEEP_NEXT], "SWEEP_NEXT", "Next", ISS_OFF);
+    IUFillSwitch(&SweepControlS[SWEEP_ABORT], "SWEEP_ABORT", "Abort", ISS_OFF);
+    IUFillSwitchVector(&SweepControlSP, SweepControlS, 2, getDeviceName(), "FOCUS_SWEEP_CONTROL", "Control", SWEEP_TAB, IP_RW,
+                       ISR_ATMOST1, 0, IPS_IDLE);
+
+    // Host temperature compensation
+    IUFillSwitch(&HostCompensateS[INDI_ENABLED], "INDI_ENABLED", "Enable", ISS_OFF);
+    IUFillSwitch(&HostCompensateS[INDI_DISABLED], "INDI_DISABLED", "Disable", ISS_ON);
+    IUFillSwitchVector(&HostCompensateSP, HostCompensateS, 2, getDeviceName(), "FOCUS_HOST_COMPENSATION", "Host Compensate",
+                       COMPENSATION_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&CompensationSettingsN[COMPENSATION_FILTER], "COMPENSATION_FILTER", "Filter slot", "%.f", 1,
+                 TemperatureModel::MAX_FILTERS, 1, 1);
+    IUFillNumber(&CompensationSettingsN[COMPENSATION_DEADBAND], "COMPENSATION_DEADBAND", "Deadband (steps)", "%.f", 1, 10000,
+                 10, 20);
+    IUFillNumber(&CompensationSettingsN[COMPENSATION_ORDER], "COMPENSATION_ORDER", "Fit order", "%.f", 1,
+                 TemperatureModel::MAX_ORDER, 1, 1);
+    IUFillNumberVector(&CompensationSettingsNP, CompensationSettingsN, 3, getDeviceName(), "FOCUS_COMPENSATION_SETTINGS",
+                       "Settings", COMPENSATION_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Record the current position as the best focus at the current temperature
+    IUFillSwitch(&CompensationRecordS[COMPENSATION_RECORD], "COMPENSATION_RECORD", "Record focus", ISS_OFF);
+    IUFillSwitch(&CompensationRecordS[COMPENSATION_CLEAR], "COMPENSATION_CLEAR", "Clear filter", ISS_OFF);
+    IUFillSwitchVector(&CompensationRecordSP, CompensationRecordS, 2, getDeviceName(), "FOCUS_COMPENSATION_RECORD", "Focus runs",
+                       COMPENSATION_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+    IUFillNumber(&CompensationModelN[MODEL_POINTS], "MODEL_POINTS", "Points", "%.f", 0, TemperatureModel::MAX_POINTS, 0, 0);
+    IUFillNumber(&CompensationModelN[MODEL_C0], "MODEL_C0", "Position at 0 C", "%.1f", -1e7, 1e7, 0, 0);
+    IUFillNumber(&CompensationModelN[MODEL_C1], "MODEL_C1", "Steps / C", "%.3f", -1e6, 1e6, 0, 0);
+    IUFillNumber(&CompensationModelN[MODEL_C2], "MODEL_C2", "Steps / C^2", "%.4f", -1e6, 1e6, 0, 0);
+    IUFillNumberVector(&CompensationModelNP, CompensationModelN, 4, getDeviceName(), "FOCUS_COMPENSATION_MODEL", "Model",
+                       COMPENSATION_TAB, IP_RO, 0, IPS_IDLE);
+
+    char path[MAXRBUF] = {0};
+    devicePath("_temperature.txt", path, MAXRBUF);
+    temperatureModel.load(path);
+
+    // Serial I/O diagnostics
+    IUFillNumber(&IOStatsN[STATS_BYTES_IN], "STATS_BYTES_IN", "Bytes in", "%.f", 0, 1e15, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_BYTES_OUT], "STATS_BYTES_OUT", "Bytes out", "%.f", 0, 1e15, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_TIMEOUTS], "STATS_TIMEOUTS", "Timeouts", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_RETRIES], "STATS_RETRIES", "Retries", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_STALE], "STATS_STALE", "Stale frames", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_DROPPED], "STATS_DROPPED", "Dropped events", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_REPLY_TIMEOUT], "STATS_REPLY_TIMEOUT", "Reply timeout (ms)", "%.f", 0, 1e6, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_CRC_ERRORS], "STATS_CRC_ERRORS", "CRC errors", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_RECONNECTS], "STATS_RECONNECTS", "Reconnects", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_PREEMPTED], "STATS_PREEMPTED", "Polls preempted", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&IOStatsN[STATS_SKIPPED_WRITES], "STATS_SKIPPED_WRITES", "Writes skipped", "%.f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&IOStatsNP, IOStatsN, 11, getDeviceName(), "FOCUS_IO_STATS", "Serial I/O", DIAGNOSTICS_TAB, IP_RO, 0,
+                       IPS_IDLE);
+
+    IUFillNumber(&TimerHitN[LATENCY_P50], "LATENCY_P50", "p50 (ms)", "%.3f", 0, 1e6, 0, 0);
+    IUFillNumber(&TimerHitN[LATENCY_P99], "LATENCY_P99", "p99 (ms)", "%.3f", 0, 1e6, 0, 0);
+    IUFillNumber(&TimerHitN[LATENCY_MAX], "LATENCY_MAX", "Max (ms)", "%.3f", 0, 1e6, 0, 0);
+    IUFillNumberVector(&TimerHitNP, TimerHitN, 3, getDeviceName(), "FOCUS_TIMER_LATENCY", "Timer tick", DIAGNOSTICS_TAB, IP_RO, 0,
+                       IPS_IDLE);
+
+    // p50/p99/max reply latency per command code
+    IUFillText(&LatencyT[0], "LATENCY", "p50/p99/max", "");
+    IUFillTextVector(&LatencyTP, LatencyT, 1, getDeviceName(), "FOCUS_COMMAND_LATENCY", "Replies", DIAGNOSTICS_TAB, IP_RO, 0,
+                     IPS_IDLE);
+
+    IUFillSwitch(&TraceS[INDI_ENABLED], "INDI_ENABLED", "Enable", ISS_OFF);
+    IUFillSwitch(&TraceS[INDI_DISABLED], "INDI_DISABLED", "Disable", ISS_ON);
+    IUFillSwitchVector(&TraceSP, TraceS, 2, getDeviceName(), "FOCUS_TRACE", "Trace file", DIAGNOSTICS_TAB, IP_RW, ISR_1OFMANY, 0,
+                       IPS_IDLE);
+
+    IUFillSwitch(&TelemetryS[INDI_ENABLED], "INDI_ENABLED", "Enable", ISS_OFF);
+    IUFillSwitch(&TelemetryS[INDI_DISABLED], "INDI_DISABLED", "Disable", ISS_ON);
+    IUFillSwitchVector(&TelemetrySP, TelemetryS, 2, getDeviceName(), "FOCUS_TELEMETRY", "Telemetry file", DIAGNOSTICS_TAB, IP_RW,
+                       ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillSwitch(&FeedS[INDI_ENABLED], "INDI_ENABLED", "Enable", ISS_OFF);
+    IUFillSwitch(&FeedS[INDI_DISABLED], "INDI_DISABLED", "Disable", ISS_ON);
+    IUFillSwitchVector(&FeedSP, FeedS, 2, getDeviceName(), "FOCUS_SHARED_FEED", "Shared memory feed", OPTIONS_TAB, IP_RW,
+                       ISR_1OFMANY, 0, IPS_IDLE);
+
+    // Polling rates while moving and for the temperature, the polling period applies while idle.
+    IUFillNumber(&PollingN[POLL_MOVING], "POLL_MOVING", "Moving (ms)", "%.f", 50, 1000, 50, 100);
+    IUFillNumber(&PollingN[POLL_TEMPERATURE], "POLL_TEMPERATURE", "Temperature (s)", "%.f", 1, 600, 1, 30);
+    IUFillNumberVector(&PollingNP, PollingN, 2, getDeviceName(), "FOCUS_POLLING", "Polling", OPTIONS_TAB, IP_RW, 0,
+                       IPS_IDLE);
+
+    setDefaultPollingPeriod(5000);
     addDebugControl();
 
     return true;
 }
 
+void AstroStep::ISGetProperties(const char * dev)
+{
+    INDI::Focuser::ISGetProperties(dev);
+
+    // Needed before connecting, so they are defined and loaded here.
+    defineProperty(&FastConnectSP);
+    loadConfig(true, FastConnectSP.name);
+    defineProperty(&BinaryProtocolSP);
+    loadConfig(true, BinaryProtocolSP.name);
+}
+
 bool AstroStep::updateProperties()
 {
     INDI::Focuser::updateProperties();
 
     if (isConnected())
     {
+        // The snapshot below replaces the cached values once it completes.
+        cachedParams = (FastConnectS[INDI_ENABLED].s == ISS_ON) && loadParamCache();
+        if (cachedParams)
+        {
+            publisher.update(&FocusAbsPosNP);
+            publisher.update(&FocusSpeedNP);
+            publisher.update(&FocusReverseSP);
+            LOG_INFO("Showing cached parameters while they are verified.");
+        }
+
         defineProperty(&GotoHomeSP);
         defineProperty(&TemperatureNP);
         defineProperty(&TemperatureSettingNP);
         defineProperty(&TemperatureCompensateSP);
         defineProperty(&CoilPowerSP);
+        defineProperty(&PollingNP);
+        defineProperty(&AutoReconnectSP);
+        defineProperty(&TemperatureFilterSP);
+        defineProperty(&TemperatureFilterNP);
+        if (streamSupported)
+            defineProperty(&StreamNP);
+        defineProperty(&PublishRateNP);
+        defineProperty(&MotionDeadbandNP);
+        if (profilesSupported)
+        {
+            defineProperty(&SpeedProfileSP);
+            defineProperty(&SpeedProfileNP);
+        }
+        defineProperty(&PredictionNP);
+        defineProperty(&FocusSweepNP);
+        defineProperty(&SweepStatusNP);
+        defineProperty(&SweepControlSP);
+        defineProperty(&HostCompensateSP);
+        defineProperty(&CompensationSettingsNP);
+        defineProperty(&CompensationRecordSP);
+        defineProperty(&CompensationModelNP);
+        defineProperty(&IOStatsNP);
+        defineProperty(&TimerHitNP);
+        defineProperty(&LatencyTP);
+        defineProperty(&TraceSP);
+        defineProperty(&TelemetrySP);
+        defineProperty(&FeedSP);
+
+        updateCompensationModel();
 
         GetFocusParams();
 
+        // The controller may still stream from a previous session.
+        enableEvents();
+        if (profilesSupported)
+            uploadSpeedProfiles();
+
         LOG_INFO("AstroStep parameters updated, focuser ready for use.");
     }
     else
@@ -117,6 +383,29 @@ bool AstroStep::updateProperties()
         deleteProperty(TemperatureSettingNP.name);
         deleteProperty(TemperatureCompensateSP.name);
         deleteProperty(CoilPowerSP.name);
+        deleteProperty(PollingNP.name);
+        deleteProperty(AutoReconnectSP.name);
+        deleteProperty(TemperatureFilterSP.name);
+        deleteProperty(TemperatureFilterNP.name);
+        deleteProperty(StreamNP.name);
+        deleteProperty(PublishRateNP.name);
+        deleteProperty(MotionDeadbandNP.name);
+        deleteProperty(SpeedProfileSP.name);
+        deleteProperty(SpeedProfileNP.name);
+        deleteProperty(PredictionNP.name);
+        deleteProperty(FocusSweepNP.name);
+        deleteProperty(SweepStatusNP.name);
+        deleteProperty(SweepControlSP.name);
+        deleteProperty(HostCompensateSP.name);
+        deleteProperty(CompensationSettingsNP.name);
+        deleteProperty(CompensationRecordSP.name);
+        deleteProperty(CompensationModelNP.name);
+        deleteProperty(IOStatsNP.name);
+        deleteProperty(TimerHitNP.name);
+        deleteProperty(LatencyTP.name);
+        deleteProperty(TraceSP.name);
+        deleteProperty(TelemetrySP.name);
+        deleteProperty(FeedSP.name);
     }
 
     return true;
@@ -124,17 +413,95 @@ bool AstroStep::updateProperties()
 
 bool AstroStep::Handshake()
 {
+    // Completed requests are handed back to the INDI event loop through the notification pipe.
+    if (ioCallbackID < 0)
+        ioCallbackID = IEAddCallback(io.notifyFD(), &AstroStep::ioDispatchHelper, this);
+    io.setEventHandler([this](const char * frame)
+    {
+        processEvent(frame);
+    });
+
+    // A new session. A reconnect does not come through here, it keeps the statistics.
+    publisher.reset();
+    commandStats.clear();
+    timerHitLatency.clear();
+    trace.clear();
+    retries = 0;
+    reconnects = 0;
+    skippedWrites = 0;
+    resetLink();
+    if (!io.open(PortFD))
+    {
+        LOG_ERROR("Failed to start the I/O thread.");
+        return false;
+    }
+
     if (Ack())
     {
         LOG_INFO("AstroStep is online. Getting focus parameters...");
         return true;
     }
 
+    io.close();
+
     LOG_INFO(
         "Error retrieving data from AstroStep, please ensure AstroStep controller is powered and the port is correct.");
     return false;
 }
 
+void AstroStep::resetLink()
+{
+    pollPending = false;
+    linkFailures = 0;
+    nextDiagnostics = std::chrono::steady_clock::now();
+    // Requests dropped by a previous close() never complete.
+    moveInFlight = hasQueuedMove = backlashPending = false;
+    selectedProfile = -1;
+    // Nothing is known of the controller until it is read, or the cache is loaded.
+    registers.clear();
+    temperatureSampleCount = 0;
+    nextPoll = nextTemperaturePoll = std::chrono::steady_clock::now();
+    io.setPipelined(false);
+}
+
+bool AstroStep::Disconnect()
+{
+    if (TraceS[INDI_ENABLED].s == ISS_ON && trace.changed())
+        writeTrace();
+
+    if (reconnectTimerID >= 0)
+    {
+        IERmTimer(reconnectTimerID);
+        reconnectTimerID = -1;
+    }
+    linkDown = false;
+    stopReconnect();
+
+    // Keep the latest values for the next fast connect.
+    if (FastConnectS[INDI_ENABLED].s == ISS_ON && firmwareVersion > 0)
+        saveParamCache();
+
+    if (predictionTimerID >= 0)
+    {
+        IERmTimer(predictionTimerID);
+        predictionTimerID = -1;
+    }
+    if (settleTimerID >= 0)
+    {
+        IERmTimer(settleTimerID);
+        settleTimerID = -1;
+    }
+    prediction.stop();
+    stopSweep(IPS_IDLE, "Focus sweep stopped, focuser disconnected.");
+    telemetry.close();
+    feed.close();
+
+    // Stop all serial traffic before the port is closed.
+    io.close();
+    closeReopenedPort();
+    return INDI::Focuser::Disconnect();
+}
+
 const char * AstroStep::getDefaultName()
 {
     return "AstroStep";
@@ -144,306 +511,453 @@ bool AstroStep::Ack()
 {
     bool success = false;
 
-    for (int i = 0; i < 3; i++)
+    // No sleeping between attempts, the wait for the reply grows instead.
+    io.setAdaptiveTimeout(false, 0);
+    io.setRetries(0);
+    io.setBinary(false);
+    for (int i = 0; i < ML_HANDSHAKE_RETRIES && !success; i++)
     {
-        if (readVersion())
-        {
-            success = true;
-            break;
-        }
-
-        sleep(1);
+        io.setTimeout(ML_HANDSHAKE_TIMEOUT << i);
+        if (i > 0)
+            retries++;
+        success = readVersion();
     }
 
+    io.setTimeout(ML_TIMEOUT * 1000);
+    if (success && binarySupported && BinaryProtocolS[INDI_ENABLED].s == ISS_ON)
+        negotiateBinary();
+
+    endHandshake();
     return success;
 }
 
-bool AstroStep::readCoilPowerState()
+void AstroStep::endHandshake()
+{
+    // From now on the reply timeout follows the measured round trip, ML_TIMEOUT is only the
+    // ceiling. Queries that time out are sent again at once, moves never are.
+    io.setTimeout(ML_TIMEOUT * 1000);
+    io.setAdaptiveTimeout(true, getActiveConnection() == tcpConnection ? ML_TCP_MARGIN : ML_SERIAL_MARGIN);
+    io.setRetries(ML_QUERY_RETRIES);
+}
+
+bool AstroStep::readVersion()
 {
     char res[ML_RES] = {0};
 
-    if (sendCommand(":GE#", res) == false)
-    {
+    if (sendCommand(":GV#", res, true) == false)
         return false;
-    }
 
-    uint32_t temp = 0;
+    applyVersion(res);
+    return true;
+}
 
-    int rc = sscanf(res, "%u#", &temp);
+void AstroStep::applyVersion(const char * res)
+{
+    LOGF_INFO("Detected firmware version %s", res);
 
-    if (rc > 0)
-    {
-        if(temp == 0)
-        {
-            CoilPowerS[COIL_POWER_OFF].s = ISS_ON;
-        }
-        else if (temp == 1)
-        {
-            CoilPowerS[COIL_POWER_ON].s = ISS_ON;
-        }
-        else
-        {
-            LOGF_ERROR("Invalid Response: focuser Coil Power value (%s)", res);
-            return false;
-        }
-    }
-    else
-    {
-        LOGF_ERROR("Unknown error: focuser Coil Power value (%s)", res);
-        return false;
-    }
-    return true;
+    if (!ReplyParser::parseVersion(res, firmwareVersion))
+        firmwareVersion = 0;
+
+    statusSupported = firmwareVersion >= ML_FW_STATUS;
+    if (statusSupported)
+        LOG_DEBUG("Firmware supports combined status query.");
+
+    pipelineSupported = firmwareVersion >= ML_FW_PIPELINE;
+    if (pipelineSupported)
+        LOG_DEBUG("Firmware supports pipelined commands.");
+    io.setPipelined(pipelineSupported);
+
+    gotoSupported = firmwareVersion >= ML_FW_GOTO;
+    if (gotoSupported)
+        LOG_DEBUG("Firmware supports single command goto.");
+
+    timedSupported = firmwareVersion >= ML_FW_TIMED;
+    if (timedSupported)
+        LOG_DEBUG("Firmware supports timed moves.");
+
+    streamSupported = firmwareVersion >= ML_FW_STREAM;
+    if (streamSupported)
+        LOG_DEBUG("Firmware supports position streaming.");
+
+    doneSupported = firmwareVersion >= ML_FW_DONE;
+    if (doneSupported)
+        LOG_DEBUG("Firmware reports completed moves.");
+
+    binarySupported = firmwareVersion >= ML_FW_BINARY;
+    if (binarySupported)
+        LOG_DEBUG("Firmware supports the binary protocol.");
+
+    profilesSupported = firmwareVersion >= ML_FW_PROFILES;
+    if (profilesSupported)
+        LOG_DEBUG("Firmware supports speed profiles.");
+    // Older firmware always moves at the :SD# speed.
+    selectedProfile = profilesSupported ? -1 : 0;
 }
 
-bool AstroStep::readReverseDirection()
+bool AstroStep::negotiateBinary()
 {
+    // The controller answers in the framing of each command, so the version query doubles
+    // as the probe. Nothing else is queued during the handshake.
+    io.setBinary(true);
+
     char res[ML_RES] = {0};
+    if (sendCommand(":GV#", res, true))
+    {
+        LOG_INFO("Using the binary protocol.");
+        return true;
+    }
 
-    if (sendCommand(":GR#", res) == false)
+    io.setBinary(false);
+    LOG_WARN("Controller did not answer in the binary protocol, staying with ASCII.");
+    return false;
+}
+
+bool AstroStep::parseReply(const IORequest &request, int index, ReplyParser::Values &values)
+{
+    if (!request.received[index])
         return false;
 
-    int temp = 0;
+    if (ReplyParser::parse(request.cmd[index], request.res[index], values))
+        return true;
 
-    int rc = sscanf(res, "%d#", &temp);
+    LOGF_ERROR("Invalid response to %s (%s)", request.cmd[index], request.res[index]);
+    return false;
+}
 
-    if (rc > 0)
+void AstroStep::applyReply(const ReplyParser::Values &values)
+{
+    if (values.has(ReplyParser::FIELD_POSITION))
     {
-        if(temp == 0)
-        {
-            FocusReverseS[INDI_DISABLED].s = ISS_ON;
-        }
-        else if (temp == 1)
+        measuredPos = static_cast<uint32_t>(values.get(ReplyParser::FIELD_POSITION));
+        FocusAbsPosN[0].value = measuredPos;
+        prediction.correct(measuredPos, std::chrono::steady_clock::now());
+    }
+
+    if (values.has(ReplyParser::FIELD_SPEED))
+        registers.set(DeviceRegisters::REG_SPEED, static_cast<int32_t>(values.get(ReplyParser::FIELD_SPEED)));
+
+    if (values.has(ReplyParser::FIELD_SPEED) && values.get(ReplyParser::FIELD_SPEED) != FocusSpeedN[0].value)
+    {
+        FocusSpeedN[0].value = values.get(ReplyParser::FIELD_SPEED);
+        publisher.update(&FocusSpeedNP);
+    }
+
+    if (values.has(ReplyParser::FIELD_COIL_POWER))
+    {
+        registers.set(DeviceRegisters::REG_COIL_POWER, static_cast<int32_t>(values.get(ReplyParser::FIELD_COIL_POWER)));
+        int index = (values.get(ReplyParser::FIELD_COIL_POWER) == 1) ? COIL_POWER_ON : COIL_POWER_OFF;
+        if (CoilPowerS[index].s != ISS_ON)
         {
-            FocusReverseS[INDI_ENABLED].s = ISS_ON;
+            IUResetSwitch(&CoilPowerSP);
+            CoilPowerS[index].s = ISS_ON;
+            publisher.update(&CoilPowerSP);
         }
-        else
+    }
+
+    if (values.has(ReplyParser::FIELD_REVERSE))
+    {
+        registers.set(DeviceRegisters::REG_REVERSE, static_cast<int32_t>(values.get(ReplyParser::FIELD_REVERSE)));
+        int index = (values.get(ReplyParser::FIELD_REVERSE) == 1) ? INDI_ENABLED : INDI_DISABLED;
+        if (FocusReverseS[index].s != ISS_ON)
         {
-            LOGF_ERROR("Invalid Response: focuser Reverse direction value (%s)", res);
-            return false;
+            IUResetSwitch(&FocusReverseSP);
+            FocusReverseS[index].s = ISS_ON;
+            publisher.update(&FocusReverseSP);
         }
     }
-    else
+
+    // Both settings share one vector, publish it once.
+    bool settingsChanged = false;
+    if (values.has(ReplyParser::FIELD_CALIBRATION))
+        registers.set(DeviceRegisters::REG_CALIBRATION, static_cast<int32_t>(values.get(ReplyParser::FIELD_CALIBRATION)));
+    if (values.has(ReplyParser::FIELD_COEFFICIENT))
+        registers.set(DeviceRegisters::REG_COEFFICIENT, static_cast<int32_t>(values.get(ReplyParser::FIELD_COEFFICIENT)));
+    if (values.has(ReplyParser::FIELD_CALIBRATION) && values.get(ReplyParser::FIELD_CALIBRATION) != TemperatureSettingN[0].value)
     {
-        LOGF_ERROR("Unknown error: focuser Reverse direction value (%s)", res);
-        return false;
+        TemperatureSettingN[0].value = values.get(ReplyParser::FIELD_CALIBRATION);
+        settingsChanged = true;
     }
-    return true;
+    if (values.has(ReplyParser::FIELD_COEFFICIENT) && values.get(ReplyParser::FIELD_COEFFICIENT) != TemperatureSettingN[1].value)
+    {
+        TemperatureSettingN[1].value = values.get(ReplyParser::FIELD_COEFFICIENT);
+        settingsChanged = true;
+    }
+    if (settingsChanged)
+        publisher.update(&TemperatureSettingNP);
 }
 
-
-bool AstroStep::readVersion()
+bool AstroStep::setTemperatureCalibration(uint32_t calibration, std::function<void(bool)> done)
 {
-    char res[ML_RES] = {0};
-
-    if (sendCommand(":GV#", res, true) == false)
-        return false;
-
-    LOGF_INFO("Detected firmware version %s", res);
-
-    return true;
+    auto cmd = Command::CALIBRATION.encode(calibration);
+    return writeRegister(DeviceRegisters::REG_CALIBRATION, static_cast<int32_t>(calibration), cmd.text, done);
 }
 
-bool AstroStep::readTemperature()
+bool AstroStep::setTemperatureCoefficient(uint32_t compensation, std::function<void(bool)> done)
 {
-    char res[ML_RES] = {0};
+    auto cmd = Command::COEFFICIENT.encode(static_cast<int32_t>(compensation));
+    return writeRegister(DeviceRegisters::REG_COEFFICIENT, static_cast<int32_t>(compensation), cmd.text, done);
+}
 
-    if (sendCommand(":GT#", res) == false)
-        return false;
+bool AstroStep::SyncFocuser(uint32_t ticks)
+{
+    compensationReferenceValid = false;
 
-    int wholepart = 0;
-    int fractpart = 0;
-    int rc = sscanf(res, "%d.%d#", &wholepart, &fractpart);
-    if (rc > 0)
-        // Signed hex
-        TemperatureN[0].value = float(wholepart + fractpart / 10);
-    else
+    auto cmd = Command::SYNC.encode(static_cast<int32_t>(ticks));
+    return queueCommand(cmd.text, [this](bool success)
     {
-        LOGF_ERROR("Unknown error: focuser temperature value (%s)", res);
-        return false;
-    }
-
-    return true;
+        if (!success)
+        {
+            FocusSyncNP.s = IPS_ALERT;
+            IDSetNumber(&FocusSyncNP, nullptr);
+        }
+    });
 }
 
-bool AstroStep::readTemperatureCoefficient()
+bool AstroStep::MoveFocuser(uint32_t position)
 {
-    char res[ML_RES] = {0};
-
-    if (sendCommand(":GC#", res) == false)
-        return false;
-
-    int wholepart = 0;
-    int fractpart = 0;
-    int rc = sscanf(res, "%d.%d#", &wholepart, &fractpart);
-    if (rc > 0)
-        // Signed hex
-        TemperatureSettingN[1].value = float(wholepart + fractpart / 10);
-    else
+    moveSequence++;
+    lastStreamFrame = std::chrono::steady_clock::now();
+    motion.start(position);
+    int profile = moveProfile(position);
+    startPrediction(position, profile);
+    // Any move not made by the compensation itself sets a new reference focus.
+    if (!compensationMove)
+        compensationReferenceValid = false;
+
+    // A move is still on its way to the controller, or one was written less than a poll tick
+    // ago. Only the final target of a burst is sent, once the window has passed.
+    if (moveInFlight || std::chrono::steady_clock::now() < nextMoveWrite)
     {
-        LOGF_ERROR("Unknown error: focuser temperature value (%s)", res);
-        return false;
+        queuedMove = position;
+        hasQueuedMove = true;
+        return true;
     }
 
-    return true;
+    return sendMove(position);
 }
 
-bool AstroStep::readTemperatureCalibration()
+bool AstroStep::sendMove(uint32_t position)
 {
-    char res[ML_RES] = {0};
+    int profile = moveProfile(position);
+    CommandFormat::Text select {}, cmd {};
+    const char * cmds[3] = {nullptr};
+    int count = 0;
 
-    if (sendCommand(":GO#", res) == false)
-        return false;
+    // Profiles stay on the controller, only a change of profile is sent.
+    if (profile != selectedProfile)
+    {
+        select = Command::PROFILE.encode(profile);
+        cmds[count++] = select.text;
+        selectedProfile = profile;
+    }
 
-    int wholepart = 0;
-    int fractpart = 0;
-    int rc = sscanf(res, "%d.%d#", &wholepart, &fractpart);
-    if (rc > 0)
-        // Signed hex
-        TemperatureSettingN[0].value = float(wholepart + fractpart / 10);
+    // Newer firmware sets the target and starts motion in a single command
+    if (gotoSupported)
+    {
+        cmd = Command::GOTO.encode(static_cast<int32_t>(position));
+        cmds[count++] = cmd.text;
+    }
+    // Set Position First, then start motion toward position
     else
     {
-        LOGF_ERROR("Unknown error: focuser temperature value (%s)", res);
-        return false;
+        cmd = Command::TARGET.encode(static_cast<int32_t>(position));
+        cmds[count++] = cmd.text;
+        cmds[count++] = ":FG#";
     }
 
-    return true;
-}
+    moveInFlight = true;
+    nextMoveWrite = std::chrono::steady_clock::now() + std::chrono::milliseconds(static_cast<int>
+                    (PollingN[POLL_MOVING].value));
+    updateFeed();
 
-bool AstroStep::readPosition()
-{
-    char res[ML_RES] = {0};
+    bool rc = queueCommands(cmds, count, false, [this](IORequest & request)
+    {
+        moveInFlight = false;
 
-    if (sendCommand(":GP#", res) == false)
-        return false;
+        if (request.status == IORequest::IO_OK)
+        {
+            // The start of the move, as sent to the controller
+            recordTelemetry();
+            updateFeed();
+            flushQueuedMove();
+            return;
+        }
 
-    int pos;
-    int rc = sscanf(res, "%i#", &pos);
+        selectedProfile = -1;
+        if (request.status == IORequest::IO_CANCELLED)
+        {
+            // Cancelled by a stop. A move asked for since then goes out now, after the stop.
+            if (hasQueuedMove)
+            {
+                nextMoveWrite = std::chrono::steady_clock::time_point();
+                flushQueuedMove();
+                return;
+            }
 
-    if (rc > 0)
-        FocusAbsPosN[0].value = pos;
-    else
-    {
-        LOGF_ERROR("Unknown error: focuser position value (%s)", res);
-        return false;
-    }
+            backlashPending = false;
+            motion.stop();
+            prediction.stop();
+            if (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY)
+            {
+                FocusAbsPosNP.s = IPS_IDLE;
+                FocusRelPosNP.s = IPS_IDLE;
+                publisher.update(&FocusAbsPosNP);
+                publisher.update(&FocusRelPosNP);
+            }
+            updateFeed();
+            return;
+        }
 
-    return true;
+        hasQueuedMove = false;
+        backlashPending = false;
+        FocusAbsPosNP.s = IPS_ALERT;
+        FocusRelPosNP.s = IPS_ALERT;
+        publisher.update(&FocusAbsPosNP);
+        publisher.update(&FocusRelPosNP);
+        stopSweep(IPS_ALERT, "Focus sweep failed, move not accepted.");
+    });
+
+    return rc;
 }
 
-bool AstroStep::readSpeed()
+void AstroStep::flushQueuedMove()
 {
-    char res[ML_RES] = {0};
+    if (!hasQueuedMove || moveInFlight || std::chrono::steady_clock::now() < nextMoveWrite)
+        return;
 
-    if (sendCommand(":GD#", res) == false)
+    hasQueuedMove = false;
+    if (!sendMove(queuedMove))
     {
-        return false;
+        FocusAbsPosNP.s = IPS_ALERT;
+        FocusRelPosNP.s = IPS_ALERT;
+        publisher.update(&FocusAbsPosNP);
+        publisher.update(&FocusRelPosNP);
     }
+}
 
-    int speed = 0;
-    int rc = sscanf(res, "%i#", &speed);
+IPState AstroStep::planMove(uint32_t target)
+{
+    // The new target replaces a timed move, whose watchdog would otherwise stop this one.
+    endTimedMove(IPS_IDLE);
 
-    if (rc > 0)
-    {
-        FocusSpeedN[0].value = speed;
-    }
-    else
+    bool isBusy = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY);
+    uint32_t position = measuredPos;
+
+    if (!isBusy && !moveInFlight)
     {
-        LOGF_ERROR("Unknown error: focuser speed value (%s)", res);
-        return false;
+        uint32_t distance = (target > position) ? target - position : position - target;
+        if (distance < MotionDeadbandN[0].value)
+        {
+            LOGF_DEBUG("Move of %u steps is below the deadband, skipped.", distance);
+            return IPS_OK;
+        }
     }
-    return true;
-}
 
-bool AstroStep::isMoving()
-{
-    char res[ML_RES] = {0};
+    targetPos = target;
+    backlashPending = false;
 
-    if (sendCommand(":GI#", res) == false)
-        return false;
+    // Overshoot so the final approach is always in the direction of the backlash sign.
+    uint32_t first = target;
+    int32_t backlash = (FocusBacklashS[INDI_ENABLED].s == ISS_ON) ? static_cast<int32_t>(FocusBacklashN[0].value) : 0;
+    if (backlash > 0 && target < position)
+        first = static_cast<uint32_t>(std::max(FocusAbsPosN[0].min, static_cast<double>(target) - backlash));
+    else if (backlash < 0 && target > position)
+        first = static_cast<uint32_t>(std::min(FocusAbsPosN[0].max, static_cast<double>(target) - backlash));
 
-    // JM 2020-03-13: 01# and 1# should be both accepted
-    if (strstr(res, "1#"))
-        return true;
-    else if (strstr(res, "0#"))
-        return false;
+    if (first != target)
+        backlashPending = true;
 
-    LOGF_ERROR("Unknown error: isMoving value (%s)", res);
-    return false;
+    if (!MoveFocuser(first))
+    {
+        backlashPending = false;
+        return IPS_ALERT;
+    }
+
+    return IPS_BUSY;
 }
 
-bool AstroStep::setTemperatureCalibration(uint32_t calibration)
+bool AstroStep::SetFocuserBacklash(int32_t steps)
 {
-    char cmd[ML_RES] = {0};
-    snprintf(cmd, ML_RES, ":SO%u#", calibration);
-    return sendCommand(cmd);
+    INDI_UNUSED(steps);
+    // Applied on the host by planMove(), nothing to send.
+    return true;
 }
 
-bool AstroStep::setTemperatureCoefficient(uint32_t compensation)
+bool AstroStep::SetFocuserBacklashEnabled(bool enabled)
 {
-    char cmd[ML_RES] = {0};
-    snprintf(cmd, ML_RES, ":SC%d#", compensation);
-    return sendCommand(cmd);
+    INDI_UNUSED(enabled);
+    return true;
 }
 
-bool AstroStep::SyncFocuser(uint32_t ticks)
+bool AstroStep::setCoilPowerState(CoilPower enable, std::function<void(bool)> done)
 {
-    char cmd[ML_RES] = {0};
-    snprintf(cmd, ML_RES, ":SP%09i#", ticks);
-    return sendCommand(cmd);
+    auto cmd = Command::COIL_POWER.encode(enable);
+    return writeRegister(DeviceRegisters::REG_COIL_POWER, enable, cmd.text, done);
 }
 
-bool AstroStep::MoveFocuser(uint32_t position)
+bool AstroStep::ReverseFocuser(bool enable)
 {
-    char cmd[ML_RES] = {0};
-    snprintf(cmd, ML_RES, ":SN%09i#", position);
-    // Set Position First
-    if (sendCommand(cmd) == false)
-        return false;
-    // Now start motion toward position
-    if (sendCommand(":FG#") == false)
-        return false;
-
-    return true;
+    auto cmd = Command::REVERSE.encode(enable);
+    return writeRegister(DeviceRegisters::REG_REVERSE, enable, cmd.text, [this](bool success)
+    {
+        if (!success)
+        {
+            FocusReverseSP.s = IPS_ALERT;
+            IDSetSwitch(&FocusReverseSP, nullptr);
+        }
+    });
 }
 
-bool AstroStep::setCoilPowerState(CoilPower enable)
+bool AstroStep::setGotoHome(std::function<void(bool)> done)
 {
-    char cmd[ML_RES] = {0};
-    snprintf(cmd, ML_RES, ":SE%d#", enable);
-    return sendCommand(cmd);
+    // Stop any motion in progress first, stopping an idle motor is harmless. The stop makes
+    // this a stop request, which goes ahead of any queued traffic.
+    const char * cmds[] = {":FQ#", ":HO#"};
+
+    return queueCommands(cmds, 2, false, [done](IORequest & request)
+    {
+        if (done)
+            done(request.status == IORequest::IO_OK);
+    });
 }
 
-bool AstroStep::ReverseFocuser(bool enable)
+bool AstroStep::setSpeed(uint32_t speed, std::function<void(bool)> done)
 {
-    char cmd[ML_RES] = {0};
-    snprintf(cmd, ML_RES, ":SR%d#", static_cast<int>(enable));
-    return sendCommand(cmd);
+    auto cmd = Command::SPEED.encode(static_cast<int32_t>(speed));
+    return writeRegister(DeviceRegisters::REG_SPEED, static_cast<int32_t>(speed), cmd.text, done);
 }
 
-bool AstroStep::setGotoHome()
+bool AstroStep::uploadSpeedProfiles(std::function<void(bool)> done)
 {
-    char cmd[ML_RES] = {0};
-    if(isMoving())
+    char slew[ML_RES] = {0}, approach[ML_RES] = {0};
+    snprintf(slew, ML_RES, ":SY%d,%.f,%.f#", ML_PROFILE_SLEW, SpeedProfileN[PROFILE_SLEW_SPEED].value,
+             SpeedProfileN[PROFILE_SLEW_ACCELERATION].value);
+    snprintf(approach, ML_RES, ":SY%d,%.f,%.f#", ML_PROFILE_APPROACH, SpeedProfileN[PROFILE_APPROACH_SPEED].value,
+             SpeedProfileN[PROFILE_APPROACH_ACCELERATION].value);
+    const char * cmds[] = {slew, approach};
+
+    return queueCommands(cmds, 2, false, [done](IORequest & request)
     {
-        AbortFocuser();
-    }
-    snprintf(cmd, ML_RES, ":HO#");
-    return sendCommand(cmd);
+        if (done)
+            done(request.status == IORequest::IO_OK);
+    });
 }
 
-bool AstroStep::setSpeed(uint32_t speed)
+int AstroStep::moveProfile(uint32_t position) const
 {
-    char cmd[ML_RES] = {0};
-    snprintf(cmd, ML_RES, ":SD%i#", speed);
-    return sendCommand(cmd);
+    if (!profilesSupported || SpeedProfileS[INDI_ENABLED].s != ISS_ON)
+        return 0;
+
+    uint32_t current = measuredPos;
+    uint32_t distance = (position > current) ? position - current : current - position;
+    return (distance >= SpeedProfileN[PROFILE_DISTANCE].value) ? ML_PROFILE_SLEW : ML_PROFILE_APPROACH;
 }
 
-bool AstroStep::setTemperatureCompensation(bool enable)
+bool AstroStep::setTemperatureCompensation(bool enable, std::function<void(bool)> done)
 {
-    char cmd[ML_RES] = {0};
-    snprintf(cmd, ML_RES, ":%c#", enable ? '+' : '-');
-    return sendCommand(cmd);
+    return writeRegister(DeviceRegisters::REG_COMPENSATION, enable, enable ? ":+#" : ":-#", done);
 }
+
 bool AstroStep::ISNewSwitch(const char * dev, const char * name, ISState * states, char * names[], int n)
 {
     if (dev != nullptr && strcmp(dev, getDeviceName()) == 0)
@@ -455,42 +969,292 @@ bool AstroStep::ISNewSwitch(const char * dev, const char * name, ISState * state
             int last_index = IUFindOnSwitchIndex(&TemperatureCompensateSP);
             IUUpdateSwitch(&TemperatureCompensateSP, states, names, n);
 
-            bool rc = setTemperatureCompensation((TemperatureCompensateS[0].s == ISS_ON));
+            TemperatureCompensateSP.s = IPS_BUSY;
+            IDSetSwitch(&TemperatureCompensateSP, nullptr);
 
-            if (!rc)
+            // Only one of the firmware and host compensation may drive the focuser.
+            if (TemperatureCompensateS[0].s == ISS_ON && HostCompensateS[INDI_ENABLED].s == ISS_ON)
             {
-                TemperatureCompensateSP.s = IPS_ALERT;
-                IUResetSwitch(&TemperatureCompensateSP);
-                TemperatureCompensateS[last_index].s = ISS_ON;
-                IDSetSwitch(&TemperatureCompensateSP, nullptr);
-                return false;
+                IUResetSwitch(&HostCompensateSP);
+                HostCompensateS[INDI_DISABLED].s = ISS_ON;
+                HostCompensateSP.s = IPS_IDLE;
+                IDSetSwitch(&HostCompensateSP, nullptr);
             }
 
-            TemperatureCompensateSP.s = IPS_OK;
-            IDSetSwitch(&TemperatureCompensateSP, nullptr);
+            setTemperatureCompensation((TemperatureCompensateS[0].s == ISS_ON), [this, last_index](bool success)
+            {
+                if (!success)
+                {
+                    TemperatureCompensateSP.s = IPS_ALERT;
+                    IUResetSwitch(&TemperatureCompensateSP);
+                    TemperatureCompensateS[last_index].s = ISS_ON;
+                    IDSetSwitch(&TemperatureCompensateSP, nullptr);
+                    return;
+                }
+
+                TemperatureCompensateSP.s = IPS_OK;
+                IDSetSwitch(&TemperatureCompensateSP, nullptr);
+            });
             return true;
         }
 
         if (strcmp(GotoHomeSP.name, name) == 0)
         {
-            bool rc = setGotoHome();
-            if (!rc)
+            GotoHomeSP.s = IPS_BUSY;
+            IDSetSwitch(&GotoHomeSP, nullptr);
+
+            setGotoHome([this](bool success)
             {
-                IUResetSwitch(&GotoHomeSP);
-                CoilPowerSP.s              = IPS_ALERT;
+                if (!success)
+                {
+                    IUResetSwitch(&GotoHomeSP);
+                    GotoHomeSP.s = IPS_ALERT;
+                    IDSetSwitch(&GotoHomeSP, nullptr);
+                    return;
+                }
+
+                GotoHomeSP.s = IPS_OK;
                 IDSetSwitch(&GotoHomeSP, nullptr);
-                return false;
+            });
+            return true;
+        }
+
+        // Trace file
+        if (strcmp(TraceSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&TraceSP, states, names, n);
+            if (TraceS[INDI_ENABLED].s == ISS_ON)
+            {
+                char path[MAXRBUF] = {0};
+                devicePath("_trace.txt", path, MAXRBUF);
+                LOGF_INFO("Tracing the last %d transactions to %s.", TraceRing::MAX_RECORDS, path);
             }
+            else
+                writeTrace();
 
-            GotoHomeSP.s = IPS_OK;
-            IDSetSwitch(&GotoHomeSP, nullptr);
+            TraceSP.s = (TraceS[INDI_ENABLED].s == ISS_ON) ? IPS_OK : IPS_IDLE;
+            IDSetSwitch(&TraceSP, nullptr);
             return true;
         }
 
-        // Coil Power Mode
-        if (strcmp(CoilPowerSP.name, name) == 0)
+        // Speed profiles
+        if (strcmp(SpeedProfileSP.name, name) == 0)
         {
-            int current_mode = IUFindOnSwitchIndex(&CoilPowerSP);
+            IUUpdateSwitch(&SpeedProfileSP, states, names, n);
+            SpeedProfileSP.s = IPS_OK;
+            IDSetSwitch(&SpeedProfileSP, nullptr);
+            return true;
+        }
+
+        // Telemetry file
+        if (strcmp(TelemetrySP.name, name) == 0)
+        {
+            IUUpdateSwitch(&TelemetrySP, states, names, n);
+            TelemetrySP.s = IPS_IDLE;
+            if (TelemetryS[INDI_ENABLED].s == ISS_ON)
+            {
+                char path[MAXRBUF] = {0};
+                devicePath("_telemetry.bin", path, MAXRBUF);
+                if (telemetry.isOpen() || telemetry.create(path, ML_TELEMETRY_SAMPLES))
+                {
+                    LOGF_INFO("Recording telemetry to %s.", path);
+                    TelemetrySP.s = IPS_OK;
+                }
+                else
+                {
+                    LOGF_ERROR("Failed to open telemetry file %s.", path);
+                    IUResetSwitch(&TelemetrySP);
+                    TelemetryS[INDI_DISABLED].s = ISS_ON;
+                    TelemetrySP.s = IPS_ALERT;
+                }
+            }
+            else
+                telemetry.close();
+
+            IDSetSwitch(&TelemetrySP, nullptr);
+            return true;
+        }
+
+        // Shared memory feed
+        if (strcmp(FeedSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&FeedSP, states, names, n);
+            FeedSP.s = IPS_IDLE;
+            if (FeedS[INDI_ENABLED].s == ISS_ON)
+            {
+                char segment[PositionFeed::MAX_NAME] = {0};
+                PositionFeed::segmentName(getDeviceName(), segment, sizeof(segment));
+                if (feed.isOpen() || feed.create(segment))
+                {
+                    LOGF_INFO("Publishing the focuser state to shared memory %s.", segment);
+                    FeedSP.s = IPS_OK;
+                    updateFeed();
+                }
+                else
+                {
+                    LOGF_ERROR("Failed to create shared memory %s: %s.", segment, strerror(errno));
+                    IUResetSwitch(&FeedSP);
+                    FeedS[INDI_DISABLED].s = ISS_ON;
+                    FeedSP.s = IPS_ALERT;
+                }
+            }
+            else
+                feed.close();
+
+            IDSetSwitch(&FeedSP, nullptr);
+            return true;
+        }
+
+        // Binary protocol, used from the next connection
+        if (strcmp(BinaryProtocolSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&BinaryProtocolSP, states, names, n);
+            BinaryProtocolSP.s = IPS_OK;
+            IDSetSwitch(&BinaryProtocolSP, nullptr);
+            return true;
+        }
+
+        // Automatic reconnect, disabling it stops the attempts in progress
+        if (strcmp(AutoReconnectSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&AutoReconnectSP, states, names, n);
+            if (AutoReconnectS[INDI_DISABLED].s == ISS_ON && reconnectTimerID >= 0)
+            {
+                IERmTimer(reconnectTimerID);
+                reconnectTimerID = -1;
+                LOG_WARN("Reconnect stopped, disconnect and connect again to recover the link.");
+            }
+            else if (AutoReconnectS[INDI_ENABLED].s == ISS_ON && linkDown && reconnectTimerID < 0)
+            {
+                reconnectDelay = ML_RECONNECT_MIN;
+                reconnectTimerID = IEAddTimer(reconnectDelay, &AstroStep::reconnectHelper, this);
+            }
+            AutoReconnectSP.s = IPS_OK;
+            IDSetSwitch(&AutoReconnectSP, nullptr);
+            return true;
+        }
+
+        // Fast connect
+        if (strcmp(FastConnectSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&FastConnectSP, states, names, n);
+            FastConnectSP.s = IPS_OK;
+            IDSetSwitch(&FastConnectSP, nullptr);
+            return true;
+        }
+
+        // Host temperature compensation
+        if (strcmp(HostCompensateSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&HostCompensateSP, states, names, n);
+            compensationReferenceValid = false;
+
+            if (HostCompensateS[INDI_ENABLED].s == ISS_ON)
+            {
+                if (!temperatureModel.hasModel(compensationFilter()))
+                    LOG_WARN("No temperature model for the active filter yet, record focus runs first.");
+
+                // Only one of the firmware and host compensation may drive the focuser.
+                if (TemperatureCompensateS[0].s == ISS_ON)
+                {
+                    IUResetSwitch(&TemperatureCompensateSP);
+                    TemperatureCompensateS[1].s = ISS_ON;
+                    setTemperatureCompensation(false, [this](bool success)
+                    {
+                        TemperatureCompensateSP.s = success ? IPS_OK : IPS_ALERT;
+                        IDSetSwitch(&TemperatureCompensateSP, nullptr);
+                    });
+                }
+            }
+
+            HostCompensateSP.s = (HostCompensateS[INDI_ENABLED].s == ISS_ON) ? IPS_OK : IPS_IDLE;
+            IDSetSwitch(&HostCompensateSP, nullptr);
+            return true;
+        }
+
+        // Focus sweep control
+        if (strcmp(SweepControlSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&SweepControlSP, states, names, n);
+            bool next = SweepControlS[SWEEP_NEXT].s == ISS_ON;
+            IUResetSwitch(&SweepControlSP);
+
+            if (!sweepActive || (next && !sweepReady))
+            {
+                LOG_WARN(sweepActive ? "The focus sweep step is not ready yet." : "No focus sweep is running.");
+                SweepControlSP.s = IPS_ALERT;
+                IDSetSwitch(&SweepControlSP, nullptr);
+                return true;
+            }
+
+            if (next)
+            {
+                if (sweepTimerID >= 0)
+                {
+                    IERmTimer(sweepTimerID);
+                    sweepTimerID = -1;
+                }
+                sweepCallback();
+            }
+            else
+            {
+                AbortFocuser();
+                FocusAbsPosNP.s = IPS_IDLE;
+                FocusRelPosNP.s = IPS_IDLE;
+                publisher.update(&FocusAbsPosNP);
+                publisher.update(&FocusRelPosNP);
+            }
+
+            SweepControlSP.s = IPS_OK;
+            IDSetSwitch(&SweepControlSP, nullptr);
+            return true;
+        }
+
+        // Record or clear focus runs of the active filter
+        if (strcmp(CompensationRecordSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&CompensationRecordSP, states, names, n);
+            int filter = compensationFilter();
+
+            if (CompensationRecordS[COMPENSATION_RECORD].s == ISS_ON)
+            {
+                temperatureModel.addPoint(filter, TemperatureN[0].value, measuredPos);
+                LOGF_INFO("Recorded focus position %u at %.2f C for filter %d.", measuredPos, TemperatureN[0].value,
+                          filter + 1);
+            }
+            else if (CompensationRecordS[COMPENSATION_CLEAR].s == ISS_ON)
+            {
+                temperatureModel.clear(filter);
+                LOGF_INFO("Cleared focus runs of filter %d.", filter + 1);
+            }
+
+            char path[MAXRBUF] = {0};
+            devicePath("_temperature.txt", path, MAXRBUF);
+            if (!temperatureModel.save(path))
+                LOGF_WARN("Failed to save focus runs to %s.", path);
+
+            compensationReferenceValid = false;
+            updateCompensationModel();
+
+            IUResetSwitch(&CompensationRecordSP);
+            CompensationRecordSP.s = IPS_OK;
+            IDSetSwitch(&CompensationRecordSP, nullptr);
+            return true;
+        }
+
+        // Temperature filter
+        if (strcmp(TemperatureFilterSP.name, name) == 0)
+        {
+            IUUpdateSwitch(&TemperatureFilterSP, states, names, n);
+            TemperatureFilterSP.s = IPS_OK;
+            IDSetSwitch(&TemperatureFilterSP, nullptr);
+            return true;
+        }
+
+        // Coil Power Mode
+        if (strcmp(CoilPowerSP.name, name) == 0)
+        {
+            int current_mode = IUFindOnSwitchIndex(&CoilPowerSP);
 
             IUUpdateSwitch(&CoilPowerSP, states, names, n);
 
@@ -500,25 +1264,40 @@ bool AstroStep::ISNewSwitch(const char * dev, const char * name, ISState * state
             {
                 CoilPowerSP.s = IPS_OK;
                 IDSetSwitch(&CoilPowerSP, nullptr);
+                return true;
             }
 
-            bool rc = setCoilPowerState(static_cast<CoilPower>(target_mode));
-            if (!rc)
+            CoilPowerSP.s = IPS_BUSY;
+            IDSetSwitch(&CoilPowerSP, nullptr);
+
+            setCoilPowerState(static_cast<CoilPower>(target_mode), [this, current_mode](bool success)
             {
-                IUResetSwitch(&CoilPowerSP);
-                CoilPowerS[current_mode].s = ISS_ON;
-                CoilPowerSP.s              = IPS_ALERT;
-                IDSetSwitch(&CoilPowerSP, nullptr);
-                return false;
-            }
+                if (!success)
+                {
+                    IUResetSwitch(&CoilPowerSP);
+                    CoilPowerS[current_mode].s = ISS_ON;
+                    CoilPowerSP.s              = IPS_ALERT;
+                    IDSetSwitch(&CoilPowerSP, nullptr);
+                    return;
+                }
 
-            CoilPowerSP.s = IPS_OK;
-            IDSetSwitch(&CoilPowerSP, nullptr);
+                CoilPowerSP.s = IPS_OK;
+                IDSetSwitch(&CoilPowerSP, nullptr);
+            });
             return true;
         }
     }
 
-    return INDI::Focuser::ISNewSwitch(dev, name, states, names, n);
+    if (!INDI::Focuser::ISNewSwitch(dev, name, states, names, n))
+        return false;
+
+    // An abort sets the moves idle and sends them from the base class.
+    if (dev != nullptr && strcmp(dev, getDeviceName()) == 0 && strcmp(name, FocusAbortSP.name) == 0)
+    {
+        publisher.sent(&FocusAbsPosNP);
+        publisher.sent(&FocusRelPosNP);
+    }
+    return true;
 }
 
 bool AstroStep::ISNewNumber(const char * dev, const char * name, double values[], char * names[], int n)
@@ -529,67 +1308,419 @@ bool AstroStep::ISNewNumber(const char * dev, const char * name, double values[]
         if (strcmp(name, TemperatureSettingNP.name) == 0)
         {
             IUUpdateNumber(&TemperatureSettingNP, values, names, n);
-            if (!setTemperatureCalibration(TemperatureSettingN[0].value) ||
-                    !setTemperatureCoefficient(TemperatureSettingN[1].value))
+
+            TemperatureSettingNP.s = IPS_BUSY;
+            IDSetNumber(&TemperatureSettingNP, nullptr);
+
+            // Only the values the controller does not hold yet are sent. A skipped write completes
+            // at once, so whichever completion comes last reports the outcome of both.
+            auto pending = std::make_shared<int>(2);
+            auto allRC = std::make_shared<bool>(true);
+            auto done = [this, pending, allRC](bool success)
             {
-                TemperatureSettingNP.s = IPS_ALERT;
+                *allRC = *allRC && success;
+                if (--*pending > 0)
+                    return;
+                TemperatureSettingNP.s = *allRC ? IPS_OK : IPS_ALERT;
                 IDSetNumber(&TemperatureSettingNP, nullptr);
-                return false;
+            };
+            setTemperatureCalibration(TemperatureSettingN[0].value, done);
+            setTemperatureCoefficient(TemperatureSettingN[1].value, done);
+            return true;
+        }
+
+        // Position stream
+        if (strcmp(name, StreamNP.name) == 0)
+        {
+            IUUpdateNumber(&StreamNP, values, names, n);
+            StreamNP.s = IPS_BUSY;
+            IDSetNumber(&StreamNP, nullptr);
+
+            setStreamInterval(static_cast<uint32_t>(StreamN[0].value), [this](bool success)
+            {
+                StreamNP.s = success ? IPS_OK : IPS_ALERT;
+                IDSetNumber(&StreamNP, nullptr);
+            });
+            return true;
+        }
+
+        // Publication rate
+        if (strcmp(name, PublishRateNP.name) == 0)
+        {
+            IUUpdateNumber(&PublishRateNP, values, names, n);
+            publisher.setMinInterval(static_cast<int>(1000 / PublishRateN[0].value));
+            PublishRateNP.s = IPS_OK;
+            IDSetNumber(&PublishRateNP, nullptr);
+            return true;
+        }
+
+        // Motion deadband
+        if (strcmp(name, MotionDeadbandNP.name) == 0)
+        {
+            IUUpdateNumber(&MotionDeadbandNP, values, names, n);
+            MotionDeadbandNP.s = IPS_OK;
+            IDSetNumber(&MotionDeadbandNP, nullptr);
+            return true;
+        }
+
+        // Focus sweep
+        if (strcmp(name, FocusSweepNP.name) == 0)
+        {
+            if (sweepActive)
+            {
+                LOG_WARN("A focus sweep is already running.");
+                FocusSweepNP.s = IPS_BUSY;
+                IDSetNumber(&FocusSweepNP, nullptr);
+                return true;
             }
 
-            TemperatureSettingNP.s = IPS_OK;
-            IDSetNumber(&TemperatureSettingNP, nullptr);
+            IUUpdateNumber(&FocusSweepNP, values, names, n);
+            if (!startSweep())
+            {
+                FocusSweepNP.s = IPS_ALERT;
+                IDSetNumber(&FocusSweepNP, nullptr);
+            }
+            return true;
+        }
+
+        // Speed profiles
+        if (strcmp(name, SpeedProfileNP.name) == 0)
+        {
+            double previous[5];
+            for (int i = 0; i < 5; i++)
+                previous[i] = SpeedProfileN[i].value;
+            IUUpdateNumber(&SpeedProfileNP, values, names, n);
+
+            // The controller already has them, e.g. when the config is loaded on connect.
+            bool changed = false;
+            for (int i = 0; i < PROFILE_DISTANCE; i++)
+                changed = changed || previous[i] != SpeedProfileN[i].value;
+            if (!changed)
+            {
+                SpeedProfileNP.s = IPS_OK;
+                IDSetNumber(&SpeedProfileNP, nullptr);
+                return true;
+            }
+
+            SpeedProfileNP.s = IPS_BUSY;
+            IDSetNumber(&SpeedProfileNP, nullptr);
+            bool rc = uploadSpeedProfiles([this](bool success)
+            {
+                SpeedProfileNP.s = success ? IPS_OK : IPS_ALERT;
+                IDSetNumber(&SpeedProfileNP, nullptr);
+            });
+            if (!rc)
+            {
+                SpeedProfileNP.s = IPS_ALERT;
+                IDSetNumber(&SpeedProfileNP, nullptr);
+            }
+            return true;
+        }
+
+        // Position prediction
+        if (strcmp(name, PredictionNP.name) == 0)
+        {
+            IUUpdateNumber(&PredictionNP, values, names, n);
+            PredictionNP.s = IPS_OK;
+            IDSetNumber(&PredictionNP, nullptr);
+            return true;
+        }
+
+        // Host compensation settings
+        if (strcmp(name, CompensationSettingsNP.name) == 0)
+        {
+            IUUpdateNumber(&CompensationSettingsNP, values, names, n);
+            compensationReferenceValid = false;
+            updateCompensationModel();
+            CompensationSettingsNP.s = IPS_OK;
+            IDSetNumber(&CompensationSettingsNP, nullptr);
+            return true;
+        }
+
+        // Temperature filter settings
+        if (strcmp(name, TemperatureFilterNP.name) == 0)
+        {
+            IUUpdateNumber(&TemperatureFilterNP, values, names, n);
+            TemperatureFilterNP.s = IPS_OK;
+            IDSetNumber(&TemperatureFilterNP, nullptr);
+            return true;
+        }
+
+        // Polling rates
+        if (strcmp(name, PollingNP.name) == 0)
+        {
+            IUUpdateNumber(&PollingNP, values, names, n);
+            nextTemperaturePoll = std::chrono::steady_clock::now();
+            PollingNP.s = IPS_OK;
+            IDSetNumber(&PollingNP, nullptr);
             return true;
         }
     }
 
-    return INDI::Focuser::ISNewNumber(dev, name, values, names, n);
+    if (!INDI::Focuser::ISNewNumber(dev, name, values, names, n))
+        return false;
+
+    // The base class sends the state of the moves it starts, busy, itself. The end of the move
+    // is a change from that state and must not wait for the publish interval.
+    if (dev != nullptr && strcmp(dev, getDeviceName()) == 0)
+    {
+        if (strcmp(name, FocusAbsPosNP.name) == 0)
+            publisher.sent(&FocusAbsPosNP);
+        else if (strcmp(name, FocusRelPosNP.name) == 0)
+            publisher.sent(&FocusRelPosNP);
+        else if (strcmp(name, FocusTimerNP.name) == 0)
+            publisher.sent(&FocusTimerNP);
+    }
+    return true;
+}
+
+bool AstroStep::loadParamCache()
+{
+    char path[MAXRBUF] = {0};
+    devicePath("_params.txt", path, MAXRBUF);
+
+    FILE * fp = fopen(path, "r");
+    if (fp == nullptr)
+        return false;
+
+    // First line is the firmware version and position, the registers follow.
+    uint32_t version = 0;
+    double position = 0;
+    int rc = fscanf(fp, "%u %lf", &version, &position);
+    if (rc == 2 && version == firmwareVersion)
+        registers.load(fp);
+    fclose(fp);
+
+    // Parameters of another firmware may not mean the same thing.
+    if (rc != 2 || version != firmwareVersion)
+        return false;
+
+    measuredPos = static_cast<uint32_t>(position);
+    FocusAbsPosN[0].value = measuredPos;
+    if (registers.known(DeviceRegisters::REG_SPEED))
+        FocusSpeedN[0].value = registers.get(DeviceRegisters::REG_SPEED);
+    if (registers.known(DeviceRegisters::REG_COIL_POWER))
+    {
+        IUResetSwitch(&CoilPowerSP);
+        CoilPowerS[registers.get(DeviceRegisters::REG_COIL_POWER) ? COIL_POWER_ON : COIL_POWER_OFF].s = ISS_ON;
+    }
+    if (registers.known(DeviceRegisters::REG_REVERSE))
+    {
+        IUResetSwitch(&FocusReverseSP);
+        FocusReverseS[registers.get(DeviceRegisters::REG_REVERSE) ? INDI_ENABLED : INDI_DISABLED].s = ISS_ON;
+    }
+    if (registers.known(DeviceRegisters::REG_CALIBRATION))
+        TemperatureSettingN[0].value = registers.get(DeviceRegisters::REG_CALIBRATION);
+    if (registers.known(DeviceRegisters::REG_COEFFICIENT))
+        TemperatureSettingN[1].value = registers.get(DeviceRegisters::REG_COEFFICIENT);
+    if (registers.known(DeviceRegisters::REG_COMPENSATION))
+    {
+        IUResetSwitch(&TemperatureCompensateSP);
+        TemperatureCompensateS[registers.get(DeviceRegisters::REG_COMPENSATION) ? 0 : 1].s = ISS_ON;
+    }
+
+    lastPos = static_cast<uint32_t>(position);
+    return true;
+}
+
+void AstroStep::saveParamCache()
+{
+    char path[MAXRBUF] = {0};
+    devicePath("_params.txt", path, MAXRBUF);
+
+    FILE * fp = fopen(path, "w");
+    if (fp == nullptr)
+        return;
+
+    fprintf(fp, "%u %u\n", firmwareVersion, measuredPos);
+    registers.save(fp);
+    fclose(fp);
+}
+
+bool AstroStep::writeRegister(DeviceRegisters::Register reg, int32_t value, const char * cmd,
+                              std::function<void(bool)> done)
+{
+    if (!registers.differs(reg, value))
+    {
+        skippedWrites++;
+        if (done)
+            done(true);
+        return true;
+    }
+
+    // Written through at once, so a second change queued behind this one is compared to it.
+    registers.set(reg, value);
+    return queueCommand(cmd, [this, reg, done](bool success)
+    {
+        if (!success)
+            registers.invalidate(reg);
+        if (done)
+            done(success);
+    });
+}
+
+void AstroStep::enableEvents()
+{
+    if (streamSupported)
+        setStreamInterval(static_cast<uint32_t>(StreamN[0].value));
+    if (doneSupported)
+        writeRegister(DeviceRegisters::REG_DONE_EVENTS, 1, Command::ENABLE_DONE_EVENTS.text, nullptr);
 }
 
 void AstroStep::GetFocusParams()
 {
-    if (readPosition())
-        IDSetNumber(&FocusAbsPosNP, nullptr);
+    // Registers loaded from the cache are not read again, unless the position shows the
+    // controller lost them.
+    const char * cmds[7] = {":GP#", ":GT#"};
+    int count = 2;
+    if (!registers.known(DeviceRegisters::REG_SPEED))
+        cmds[count++] = ":GD#";
+    if (!registers.known(DeviceRegisters::REG_COIL_POWER))
+        cmds[count++] = ":GE#";
+    if (!registers.known(DeviceRegisters::REG_CALIBRATION))
+        cmds[count++] = ":GO#";
+    if (!registers.known(DeviceRegisters::REG_COEFFICIENT))
+        cmds[count++] = ":GC#";
+    if (!registers.known(DeviceRegisters::REG_REVERSE))
+        cmds[count++] = ":GR#";
+
+    bool skipped = count < 7;
+    uint32_t expected = measuredPos;
+
+    // Replies that did not arrive or do not parse are skipped.
+    queueCommands(cmds, count, true, [this, skipped, expected](IORequest & request)
+    {
+        ReplyParser::Values values;
+        bool complete = true;
+        for (int i = 0; i < request.count; i++)
+            complete = parseReply(request, i, values) && complete;
+
+        // A reset controller starts from zero with its default settings.
+        if (skipped && (!values.has(ReplyParser::FIELD_POSITION) || expected == 0 ||
+                        static_cast<uint32_t>(values.get(ReplyParser::FIELD_POSITION)) != expected))
+        {
+            LOG_INFO("Controller does not match the cached parameters, reading them.");
+            cachedParams = false;
+            registers.clear();
+            // Compensation cannot be read back, it is written instead.
+            setTemperatureCompensation(TemperatureCompensateS[0].s == ISS_ON);
+            enableEvents();
+            GetFocusParams();
+            return;
+        }
 
-    if (readTemperature())
-        IDSetNumber(&TemperatureNP, nullptr);
+        applyReply(values);
+
+        if (values.has(ReplyParser::FIELD_POSITION))
+            publisher.update(&FocusAbsPosNP);
+
+        if (values.has(ReplyParser::FIELD_TEMPERATURE))
+        {
+            addTemperatureSample(values.get(ReplyParser::FIELD_TEMPERATURE));
+            lastTemperature = TemperatureN[0].value;
+            publisher.update(&TemperatureNP);
+        }
 
-    if (readSpeed())
-        IDSetNumber(&FocusSpeedNP, nullptr);
-    
-    if (readCoilPowerState())
-        IDSetSwitch(&CoilPowerSP, nullptr);
-    
-    if (readTemperatureCalibration())
-        IDSetNumber(&TemperatureSettingNP, nullptr);
+        if (cachedParams)
+        {
+            cachedParams = false;
+            LOG_INFO(complete ? "Cached parameters verified." : "Cached parameters could not be fully verified.");
+        }
 
-    if (readTemperatureCoefficient())
-        IDSetNumber(&TemperatureSettingNP, nullptr);
-    
-    readReverseDirection();
+        if (complete)
+            saveParamCache();
+    });
 }
 
 bool AstroStep::SetFocuserSpeed(int speed)
 {
-    return setSpeed(speed);
+    return setSpeed(speed, [this](bool success)
+    {
+        if (!success)
+        {
+            FocusSpeedNP.s = IPS_ALERT;
+            IDSetNumber(&FocusSpeedNP, nullptr);
+        }
+    });
 }
 
 IPState AstroStep::MoveFocuser(FocusDirection dir, int speed, uint16_t duration)
 {
-    if (speed != static_cast<int>(FocusSpeedN[0].value))
+    if (timedSupported)
+    {
+        // The controller runs toward its own travel limit at the constant speed of timed
+        // moves, cut the duration to what reaches ours.
+        double room = (dir == FOCUS_INWARD) ? measuredPos - FocusAbsPosN[0].min : FocusMaxPosN[0].value - measuredPos;
+        if (room <= 0)
+        {
+            LOG_INFO("Focuser is already at its travel limit.");
+            return IPS_OK;
+        }
+
+        double reach = std::floor(room * 1000 / std::min(static_cast<double>(speed), ML_MAX_SPEED));
+        if (reach < duration)
+        {
+            LOGF_DEBUG("Timed move cut to %.f ms by the travel limit.", reach);
+            duration = static_cast<uint16_t>(reach);
+        }
+    }
+
+    bool rc = setSpeed(speed, [this](bool success)
+    {
+        if (!success)
+        {
+            FocusTimerNP.s = IPS_ALERT;
+            IDSetNumber(&FocusTimerNP, nullptr);
+        }
+    });
+    if (!rc)
+        return IPS_ALERT;
+
+    if (timedMoveTimerID >= 0)
+    {
+        IERmTimer(timedMoveTimerID);
+        timedMoveTimerID = -1;
+    }
+
+    // The controller times the motion itself. Its end is seen by the polls or the move done
+    // frame, the host timer is only a watchdog.
+    if (timedSupported)
     {
-        if (!setSpeed(speed))
+        // Negative durations move inward
+        auto cmd = Command::TIMED.encode((dir == FOCUS_INWARD) ? -static_cast<int32_t>(duration) : duration);
+
+        moveSequence++;
+        lastStreamFrame = std::chrono::steady_clock::now();
+        // The end position of a timed move is not known, it is confirmed with :GI#.
+        motion.stop();
+        prediction.stop();
+        backlashPending = hasQueuedMove = false;
+
+        const char * cmds[] = {cmd.text};
+        uint32_t sequence = moveSequence;
+        rc = queueCommands(cmds, 1, false, [this, sequence](IORequest & request)
+        {
+            if (request.status == IORequest::IO_OK || sequence != moveSequence)
+                return;
+            // Cancelled by a stop, which ended the move
+            endTimedMove(request.status == IORequest::IO_CANCELLED ? IPS_IDLE : IPS_ALERT);
+        });
+        if (!rc)
             return IPS_ALERT;
+
+        timedMoveTimerID = IEAddTimer(duration + ML_TIMED_WATCHDOG, &AstroStep::timedMoveHelper, this);
+        return IPS_BUSY;
     }
 
     // either go all the way in or all the way out
     // then use timer to stop
+    backlashPending = false;
     if (dir == FOCUS_INWARD)
         MoveFocuser(0);
     else
         MoveFocuser(static_cast<uint32_t>(FocusMaxPosN[0].value));
 
-    IEAddTimer(duration, &AstroStep::timedMoveHelper, this);
+    timedMoveTimerID = IEAddTimer(duration, &AstroStep::timedMoveHelper, this);
     return IPS_BUSY;
 }
 
@@ -600,144 +1731,1164 @@ void AstroStep::timedMoveHelper(void * context)
 
 void AstroStep::timedMoveCallback()
 {
+    timedMoveTimerID = -1;
+    if (timedSupported)
+        LOG_WARN("Timed move did not report its end in time, stopping it.");
+
+    // Harmless if the controller already stopped on its own.
     AbortFocuser();
     FocusAbsPosNP.s = IPS_IDLE;
     FocusRelPosNP.s = IPS_IDLE;
-    FocusTimerNP.s = IPS_IDLE;
-    FocusTimerN[0].value = 0;
-    IDSetNumber(&FocusAbsPosNP, nullptr);
-    IDSetNumber(&FocusRelPosNP, nullptr);
-    IDSetNumber(&FocusTimerNP, nullptr);
+    publisher.update(&FocusAbsPosNP);
+    publisher.update(&FocusRelPosNP);
 }
 
-IPState AstroStep::MoveAbsFocuser(uint32_t targetTicks)
+void AstroStep::endTimedMove(IPState state)
 {
-    targetPos = targetTicks;
+    if (timedMoveTimerID >= 0)
+    {
+        IERmTimer(timedMoveTimerID);
+        timedMoveTimerID = -1;
+    }
 
-    if (!MoveFocuser(targetPos))
-        return IPS_ALERT;
+    if (FocusTimerNP.s != IPS_BUSY)
+        return;
 
-    return IPS_BUSY;
+    FocusTimerNP.s = state;
+    FocusTimerN[0].value = 0;
+    publisher.update(&FocusTimerNP);
 }
 
-IPState AstroStep::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
+void AstroStep::startPrediction(uint32_t target, int profile)
 {
-    // Clamp
-    int32_t offset = ((dir == FOCUS_INWARD) ? -1 : 1) * static_cast<int32_t>(ticks);
-    int32_t newPosition = FocusAbsPosN[0].value + offset;
-    newPosition = std::max(static_cast<int32_t>(FocusAbsPosN[0].min), std::min(static_cast<int32_t>(FocusAbsPosN[0].max),
-                           newPosition));
-
-    if (!MoveFocuser(newPosition))
-        return IPS_ALERT;
+    double speed = std::min(FocusSpeedN[0].value, static_cast<double>(ML_MAX_SPEED));
+    double acceleration = PredictionN[PREDICT_ACCELERATION].value;
+    // The profile of the move is known exactly.
+    if (profile == ML_PROFILE_SLEW || profile == ML_PROFILE_APPROACH)
+    {
+        int base = (profile == ML_PROFILE_SLEW) ? PROFILE_SLEW_SPEED : PROFILE_APPROACH_SPEED;
+        speed = SpeedProfileN[base].value;
+        acceleration = SpeedProfileN[base + 1].value;
+    }
+    prediction.start(measuredPos, target, speed, acceleration, std::chrono::steady_clock::now());
+    predictionPolled = false;
 
-    FocusRelPosN[0].value = ticks;
-    FocusRelPosNP.s       = IPS_BUSY;
+    if (predictionTimerID < 0 && PredictionN[PREDICT_INTERVAL].value > 0)
+        predictionTimerID = IEAddTimer(static_cast<int>(PredictionN[PREDICT_INTERVAL].value), &AstroStep::predictionHelper, this);
+}
 
-    return IPS_BUSY;
+void AstroStep::predictionHelper(void * context)
+{
+    static_cast<AstroStep *>(context)->predictionCallback();
 }
 
-void AstroStep::TimerHit()
+void AstroStep::predictionCallback()
 {
-    if (!isConnected())
-        return;
+    predictionTimerID = -1;
 
-    bool rc = readPosition();
-    if (rc)
-    {
-        if (fabs(lastPos - FocusAbsPosN[0].value) > 5)
-        {
-            IDSetNumber(&FocusAbsPosNP, nullptr);
-            lastPos = static_cast<uint32_t>(FocusAbsPosN[0].value);
-        }
-    }
+    bool isBusy = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY);
+    if (!isConnected() || !isBusy || !prediction.active() || PredictionN[PREDICT_INTERVAL].value <= 0)
+        return;
 
-    rc = readTemperature();
-    if (rc)
-    {
-        if (fabs(lastTemperature - TemperatureN[0].value) >= 0.5)
-        {
-            IDSetNumber(&TemperatureNP, nullptr);
-            lastTemperature = static_cast<uint32_t>(TemperatureN[0].value);
-        }
-    }
+    // Only shown, every decision is taken on the measured position.
+    auto now = std::chrono::steady_clock::now();
+    FocusAbsPosN[0].value = std::round(prediction.predict(now));
+    publisher.update(&FocusAbsPosNP);
+    publisher.flush();
 
-    if (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY)
+    // Confirm the end of the move when the profile says so, not on the next poll tick.
+    if (!predictionPolled && !pollPending && prediction.remaining(now).count() == 0)
     {
-        if (!isMoving())
-        {
-            FocusAbsPosNP.s = IPS_OK;
-            FocusRelPosNP.s = IPS_OK;
-            IDSetNumber(&FocusAbsPosNP, nullptr);
-            IDSetNumber(&FocusRelPosNP, nullptr);
-            lastPos = static_cast<uint32_t>(FocusAbsPosN[0].value);
-            LOG_INFO("Focuser reached requested position.");
-        }
+        predictionPolled = true;
+        pollStatus(false);
     }
 
-    SetTimer(getCurrentPollingPeriod());
+    predictionTimerID = IEAddTimer(static_cast<int>(PredictionN[PREDICT_INTERVAL].value), &AstroStep::predictionHelper, this);
 }
 
-bool AstroStep::AbortFocuser()
+void AstroStep::scheduleSettlePoll()
 {
-    return sendCommand(":FQ#");
+    // One more sample at the target ends the move. Samples milliseconds apart would agree
+    // even on a motor still creeping in, so the next one waits a moving poll period rather
+    // than going out as soon as this one came back.
+    if (settleTimerID < 0)
+        settleTimerID = IEAddTimer(static_cast<int>(PollingN[POLL_MOVING].value), &AstroStep::settleHelper, this);
 }
 
-bool AstroStep::saveConfigItems(FILE * fp)
+void AstroStep::settleHelper(void * context)
 {
-    Focuser::saveConfigItems(fp);
-
-    return true;
+    static_cast<AstroStep *>(context)->settleCallback();
 }
 
-bool AstroStep::sendCommand(const char * cmd, char * res, bool silent, int nret)
+void AstroStep::settleCallback()
 {
-    int nbytes_written = 0, nbytes_read = 0, rc = -1;
+    settleTimerID = -1;
 
-    tcflush(PortFD, TCIOFLUSH);
+    // The tick may have taken the sample meanwhile.
+    if (isConnected() && !linkDown && !pollPending && motion.state() == MotionTracker::MOTION_SETTLING)
+        pollStatus(false);
+}
 
-    LOGF_DEBUG("CMD <%s>", cmd);
+bool AstroStep::startSweep()
+{
+    int count = static_cast<int>(FocusSweepN[SWEEP_COUNT].value);
+    double step = FocusSweepN[SWEEP_STEP].value;
+    double first = FocusSweepN[SWEEP_START].value;
+    double last = first + step * (count - 1);
 
-    if ((rc = tty_write_string(PortFD, cmd, &nbytes_written)) != TTY_OK)
+    if (count < 1 || count > ML_SWEEP_MAX)
     {
-        char errstr[MAXRBUF] = {0};
-        tty_error_msg(rc, errstr, MAXRBUF);
-        if (!silent)
-            LOGF_ERROR("Serial write error: %s.", errstr);
+        LOGF_ERROR("A focus sweep takes 1 to %d steps.", ML_SWEEP_MAX);
         return false;
     }
-
-    if (res == nullptr)
+    if (std::min(first, last) < FocusAbsPosN[0].min || std::max(first, last) > FocusAbsPosN[0].max)
     {
-        tcdrain(PortFD);
-        return true;
+        LOGF_ERROR("Focus sweep from %.f to %.f is outside the focuser range.", first, last);
+        return false;
     }
 
-    // this is to handle the GV command which doesn't return the terminator, use the number of chars expected
-    if (nret == 0)
+    // The whole run is planned up front, only the moves are left to do.
+    for (int i = 0; i < count; i++)
+        sweepPositions[i] = static_cast<uint32_t>(std::lround(first + step * i));
+    sweepCount = count;
+    sweepIndex = 0;
+    sweepActive = true;
+
+    LOGF_INFO("Focus sweep of %d steps from %.f to %.f.", count, first, last);
+    FocusSweepNP.s = IPS_BUSY;
+    IDSetNumber(&FocusSweepNP, nullptr);
+
+    sweepMove();
+    return true;
+}
+
+void AstroStep::sweepMove()
+{
+    sweepReady = false;
+
+    SweepStatusN[SWEEP_INDEX].value = sweepIndex + 1;
+    SweepStatusN[SWEEP_POSITION].value = sweepPositions[sweepIndex];
+    SweepStatusNP.s = IPS_BUSY;
+    IDSetNumber(&SweepStatusNP, nullptr);
+
+    IPState state = planMove(sweepPositions[sweepIndex]);
+    FocusAbsPosNP.s = state;
+    publisher.update(&FocusAbsPosNP);
+
+    if (state == IPS_OK)
+        sweepStepReached();
+    else if (state == IPS_ALERT)
+        stopSweep(IPS_ALERT, "Focus sweep failed, move not accepted.");
+}
+
+void AstroStep::sweepStepReached()
+{
+    if (sweepReady || sweepTimerID >= 0)
+        return;
+
+    int settle = static_cast<int>(FocusSweepN[SWEEP_SETTLE].value);
+    if (settle > 0)
+        sweepTimerID = IEAddTimer(settle, &AstroStep::sweepHelper, this);
+    else
+        sweepReadySignal();
+}
+
+void AstroStep::sweepReadySignal()
+{
+    sweepReady = true;
+
+    // Sent right away rather than through the publisher, clients start their exposure on it.
+    double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    SweepStatusN[SWEEP_READY_TIME].value = now;
+    SweepStatusNP.s = IPS_OK;
+    IDSetNumber(&SweepStatusNP, "Focus sweep step %d of %d ready at %u.", sweepIndex + 1, sweepCount,
+                sweepPositions[sweepIndex]);
+
+    int dwell = static_cast<int>(FocusSweepN[SWEEP_DWELL].value);
+    if (dwell > 0)
+        sweepTimerID = IEAddTimer(dwell, &AstroStep::sweepHelper, this);
+}
+
+void AstroStep::sweepHelper(void * context)
+{
+    static_cast<AstroStep *>(context)->sweepCallback();
+}
+
+void AstroStep::sweepCallback()
+{
+    sweepTimerID = -1;
+    if (!sweepActive)
+        return;
+
+    // Settled, or done with this step.
+    if (!sweepReady)
+    {
+        sweepReadySignal();
+        return;
+    }
+
+    if (++sweepIndex >= sweepCount)
     {
-        rc = tty_nread_section(PortFD, res, ML_RES, ML_DEL, ML_TIMEOUT, &nbytes_read);
+        stopSweep(IPS_OK, "Focus sweep complete.");
+        return;
     }
+
+    sweepMove();
+}
+
+void AstroStep::stopSweep(IPState state, const char * reason)
+{
+    if (!sweepActive)
+        return;
+
+    if (sweepTimerID >= 0)
+    {
+        IERmTimer(sweepTimerID);
+        sweepTimerID = -1;
+    }
+    sweepActive = sweepReady = false;
+
+    if (state == IPS_OK)
+        LOGF_INFO("%s", reason);
     else
+        LOGF_WARN("%s", reason);
+
+    FocusSweepNP.s = state;
+    IDSetNumber(&FocusSweepNP, nullptr);
+    if (state != IPS_OK)
     {
-        rc = tty_read(PortFD, res, nret, ML_TIMEOUT, &nbytes_read);
+        SweepStatusNP.s = state;
+        IDSetNumber(&SweepStatusNP, nullptr);
     }
-    if (rc != TTY_OK)
+}
+
+IPState AstroStep::MoveAbsFocuser(uint32_t targetTicks)
+{
+    stopSweep(IPS_ALERT, "Focus sweep interrupted by a move.");
+
+    return planMove(targetTicks);
+}
+
+IPState AstroStep::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
+{
+    stopSweep(IPS_ALERT, "Focus sweep interrupted by a move.");
+
+    // Steps of a burst add up from the last requested target, not from where the focuser is now.
+    bool isBusy = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY);
+    int32_t origin = (isBusy || moveInFlight) ? static_cast<int32_t>(targetPos) : static_cast<int32_t>(measuredPos);
+
+    // Clamp
+    int32_t offset = ((dir == FOCUS_INWARD) ? -1 : 1) * static_cast<int32_t>(ticks);
+    int32_t newPosition = origin + offset;
+    newPosition = std::max(static_cast<int32_t>(FocusAbsPosN[0].min), std::min(static_cast<int32_t>(FocusAbsPosN[0].max),
+                           newPosition));
+
+    IPState state = planMove(newPosition);
+    if (state != IPS_BUSY)
+        return state;
+
+    FocusRelPosN[0].value = ticks;
+    FocusRelPosNP.s       = IPS_BUSY;
+
+    return IPS_BUSY;
+}
+
+void AstroStep::TimerHit()
+{
+    if (!isConnected())
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (now >= nextDiagnostics)
     {
-        char errstr[MAXRBUF] = {0};
-        tty_error_msg(rc, errstr, MAXRBUF);
-        if (!silent)
-            LOGF_ERROR("%s Serial read error: %s.", cmd, errstr);
-        return false;
+        nextDiagnostics = now + std::chrono::milliseconds(ML_DIAGNOSTICS_PERIOD);
+        updateDiagnostics();
+    }
+
+    // Nothing to poll until the port is reopened.
+    if (linkDown)
+    {
+        SetTimer(static_cast<uint32_t>(PollingN[POLL_MOVING].value));
+        return;
+    }
+
+    // The final target of a burst of moves.
+    flushQueuedMove();
+
+    bool isBusy = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY || FocusTimerNP.s == IPS_BUSY);
+
+    // While the controller streams the position, moves need no polling. Fall back to it
+    // if the stream goes quiet.
+    bool streaming = streamSupported && StreamN[0].value > 0 &&
+                     now - lastStreamFrame < std::chrono::milliseconds(static_cast<int>(StreamN[0].value) * 4 + ML_STREAM_GRACE);
+
+    // Poll on every tick while moving, once per polling period otherwise.
+    // Skip this tick if the previous poll is still waiting on the controller, or if a
+    // settling move has its next sample scheduled.
+    bool settling = settleTimerID >= 0;
+    if (!pollPending && ((isBusy && !streaming && !settling) || now >= nextPoll))
+    {
+        nextPoll = now + std::chrono::milliseconds(getCurrentPollingPeriod());
+
+        bool temperatureDue = now >= nextTemperaturePoll;
+        if (temperatureDue)
+            nextTemperaturePoll = now + std::chrono::seconds(static_cast<int>(PollingN[POLL_TEMPERATURE].value));
+
+        pollStatus(temperatureDue);
+    }
+
+    // Updates held back by the rate limit.
+    publisher.flush();
+    // Also catches state changes outside the poll and move paths, e.g. an abort.
+    updateFeed();
+
+    timerHitLatency.add(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>
+                        (std::chrono::steady_clock::now() - now).count()));
+
+    SetTimer(static_cast<uint32_t>(PollingN[POLL_MOVING].value));
+}
+
+void AstroStep::pollStatus(bool temperatureDue)
+{
+    uint32_t sequence = moveSequence;
+    bool isBusy = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY || FocusTimerNP.s == IPS_BUSY);
+
+    // Query position, temperature and motion in a single round-trip if the firmware supports it.
+    if (statusSupported)
+    {
+        const char * cmds[] = {":GS#"};
+        pollPending = queueCommands(cmds, 1, true, [this, sequence, temperatureDue](IORequest & request)
+        {
+            pollPending = false;
+
+            // Support was decided from the firmware version, a bad reply is only a failed poll.
+            ReplyParser::Values values;
+            bool rc = parseReply(request, 0, values);
+            if (rc)
+                applyReply(values);
+
+            bool moving = values.get(ReplyParser::FIELD_MOVING) == 1;
+            if (rc && sequence == moveSequence)
+                moving = moving && motion.sample(measuredPos) != MotionTracker::MOTION_DONE;
+            // The status always carries the temperature, only sample it on its own cadence.
+            if (rc && temperatureDue)
+                addTemperatureSample(values.get(ReplyParser::FIELD_TEMPERATURE));
+            // Do not end a motion because a single status query failed.
+            processStatus(rc, rc && temperatureDue, rc ? moving : true, sequence);
+            if (rc)
+                recordTelemetry(request.latency[0]);
+            updateFeed();
+
+            if (motion.state() == MotionTracker::MOTION_SETTLING && sequence == moveSequence)
+                scheduleSettlePoll();
+        });
+    }
+    // Fall back to one query per field, temperature only when due.
+    else
+    {
+        // The motion flag is only asked when the positions cannot tell: the move has no known
+        // target (timed moves) or it stopped short of it.
+        MotionTracker::State state = motion.state();
+        bool askMoving = isBusy && (state == MotionTracker::MOTION_IDLE || state == MotionTracker::MOTION_STALLED);
+
+        const char * cmds[3] = {":GP#"};
+        int count = 1;
+        if (temperatureDue)
+            cmds[count++] = ":GT#";
+        if (askMoving)
+            cmds[count++] = ":GI#";
+
+        pollPending = queueCommands(cmds, count, true, [this, sequence](IORequest & request)
+        {
+            pollPending = false;
+
+            ReplyParser::Values values;
+            for (int i = 0; i < request.count; i++)
+                parseReply(request, i, values);
+            applyReply(values);
+
+            bool tempRC = values.has(ReplyParser::FIELD_TEMPERATURE);
+            if (tempRC)
+                addTemperatureSample(values.get(ReplyParser::FIELD_TEMPERATURE));
+
+            bool positionRC = values.has(ReplyParser::FIELD_POSITION);
+            MotionTracker::State state = motion.state();
+            if (positionRC && sequence == moveSequence)
+                state = motion.sample(measuredPos);
+
+            bool moving = true;
+            if (values.has(ReplyParser::FIELD_MOVING))
+                moving = values.get(ReplyParser::FIELD_MOVING) == 1;
+            else if (positionRC)
+                moving = state != MotionTracker::MOTION_DONE;
+
+            processStatus(positionRC, tempRC, moving, sequence);
+            if (positionRC)
+                recordTelemetry(request.latency[0]);
+            updateFeed();
+
+            if (motion.state() == MotionTracker::MOTION_SETTLING && sequence == moveSequence)
+                scheduleSettlePoll();
+        });
+    }
+}
+
+void AstroStep::addTemperatureSample(double temperature)
+{
+    temperatureSamples[temperatureSampleCount % ML_TEMPERATURE_WINDOW] = temperature;
+    temperatureSampleCount++;
+
+    switch (IUFindOnSwitchIndex(&TemperatureFilterSP))
+    {
+        case FILTER_EXPONENTIAL:
+        {
+            double alpha = TemperatureFilterN[FILTER_ALPHA].value;
+            temperatureAverage = (temperatureSampleCount == 1) ? temperature : alpha * temperature + (1 - alpha) *
+                                 temperatureAverage;
+            TemperatureN[0].value = temperatureAverage;
+            break;
+        }
+
+        case FILTER_MEDIAN:
+        {
+            int count = static_cast<int>(TemperatureFilterN[FILTER_WINDOW].value);
+            count = std::max(1, std::min(count, static_cast<int>(ML_TEMPERATURE_WINDOW)));
+            if (temperatureSampleCount < static_cast<uint32_t>(count))
+                count = static_cast<int>(temperatureSampleCount);
+
+            double window_samples[ML_TEMPERATURE_WINDOW];
+            // Most recent samples first
+            for (int i = 0; i < count; i++)
+                window_samples[i] = temperatureSamples[(temperatureSampleCount - 1 - i) % ML_TEMPERATURE_WINDOW];
+            std::nth_element(window_samples, window_samples + count / 2, window_samples + count);
+            TemperatureN[0].value = window_samples[count / 2];
+            break;
+        }
+
+        default:
+            TemperatureN[0].value = temperature;
+            break;
+    }
+
+    // Keep the average current so switching filters does not jump.
+    if (IUFindOnSwitchIndex(&TemperatureFilterSP) != FILTER_EXPONENTIAL)
+        temperatureAverage = TemperatureN[0].value;
+}
+
+int AstroStep::compensationFilter() const
+{
+    return static_cast<int>(CompensationSettingsN[COMPENSATION_FILTER].value) - 1;
+}
+
+void AstroStep::devicePath(const char * suffix, char * path, size_t len)
+{
+    const char * home = getenv("HOME");
+    snprintf(path, len, "%s/.indi/%s%s", home ? home : ".", getDeviceName(), suffix);
+}
+
+void AstroStep::updateCompensationModel()
+{
+    int filter = compensationFilter();
+    int order = static_cast<int>(CompensationSettingsN[COMPENSATION_ORDER].value);
+
+    temperatureModel.fit(filter, order);
+
+    const double * c = temperatureModel.coefficients(filter);
+    CompensationModelN[MODEL_POINTS].value = temperatureModel.points(filter);
+    CompensationModelN[MODEL_C0].value = c ? c[0] : 0;
+    CompensationModelN[MODEL_C1].value = c ? c[1] : 0;
+    CompensationModelN[MODEL_C2].value = c ? c[2] : 0;
+    CompensationModelNP.s = temperatureModel.hasModel(filter) ? IPS_OK : IPS_IDLE;
+    IDSetNumber(&CompensationModelNP, nullptr);
+}
+
+void AstroStep::checkHostCompensation()
+{
+    if (HostCompensateS[INDI_ENABLED].s != ISS_ON)
+        return;
+
+    int filter = compensationFilter();
+    if (!temperatureModel.hasModel(filter))
+        return;
+
+    // Nor in the middle of a focus sweep, it is finding the focus.
+    if (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY || FocusTimerNP.s == IPS_BUSY || sweepActive)
+        return;
+
+    double temperature = TemperatureN[0].value;
+
+    // Hold the focus found at this temperature, and correct relative to it.
+    if (!compensationReferenceValid)
+    {
+        compensationReferencePosition = measuredPos;
+        compensationReferenceTemperature = temperature;
+        compensationReferenceValid = true;
+        return;
     }
 
-    LOGF_DEBUG("RES <%s>", res);
+    double offset = temperatureModel.offset(filter, temperature) - temperatureModel.offset(filter,
+                    compensationReferenceTemperature);
+    double target = compensationReferencePosition + offset;
+    target = std::max(FocusAbsPosN[0].min, std::min(FocusAbsPosN[0].max, std::round(target)));
+
+    // Accumulate small drifts into a single move.
+    if (fabs(target - measuredPos) < CompensationSettingsN[COMPENSATION_DEADBAND].value)
+        return;
 
-    tcflush(PortFD, TCIOFLUSH);
+    LOGF_INFO("Temperature compensation: %.2f C, moving to %.f.", temperature, target);
+
+    compensationMove = true;
+    IPState state = MoveAbsFocuser(static_cast<uint32_t>(target));
+    compensationMove = false;
+
+    FocusAbsPosNP.s = state;
+    publisher.update(&FocusAbsPosNP);
+}
+
+bool AstroStep::setStreamInterval(uint32_t interval, std::function<void(bool)> done)
+{
+    auto cmd = Command::STREAM.encode(interval);
+    return writeRegister(DeviceRegisters::REG_STREAM, static_cast<int32_t>(interval), cmd.text, done);
+}
+
+void AstroStep::processEvent(const char * frame)
+{
+    ReplyParser::Values values;
+    if (!ReplyParser::parseEvent(frame, values))
+    {
+        LOGF_DEBUG("Ignoring unknown event (%s)", frame);
+        return;
+    }
+
+    lastStreamFrame = std::chrono::steady_clock::now();
+
+    // Every streamed position is published, the stream rate already limits them.
+    uint32_t position = static_cast<uint32_t>(values.get(ReplyParser::FIELD_POSITION));
+    measuredPos = position;
+    FocusAbsPosN[0].value = position;
+    prediction.correct(position, lastStreamFrame);
+    if (position != lastPos)
+    {
+        publisher.update(&FocusAbsPosNP);
+        lastPos = position;
+    }
+
+    // The last frame of a motion, or the move done frame, reports it stopped. Positions that
+    // settled on the target end the move too, should that frame be lost.
+    bool moving = values.get(ReplyParser::FIELD_MOVING) == 1;
+    if (moving && !moveInFlight && !hasQueuedMove)
+        moving = motion.sample(position) != MotionTracker::MOTION_DONE;
+    // A stopped frame may be left over from the previous move, read after the next one was
+    // written. One at the target of this move ends it, the status poll tells anything else.
+    else if (!moving && (moveInFlight || hasQueuedMove || motion.state() == MotionTracker::MOTION_IDLE ||
+                         position != motion.target()))
+    {
+        moving = true;
+        bool isBusy = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY || FocusTimerNP.s == IPS_BUSY);
+        if (isBusy && !pollPending)
+            pollStatus(false);
+    }
+    processStatus(true, false, moving, moveSequence);
+    recordTelemetry();
+    updateFeed();
+}
+
+void AstroStep::updateDiagnostics()
+{
+    IOStatsN[STATS_BYTES_IN].value = io.bytesIn();
+    IOStatsN[STATS_BYTES_OUT].value = io.bytesOut();
+    IOStatsN[STATS_TIMEOUTS].value = commandStats.timeouts();
+    IOStatsN[STATS_RETRIES].value = retries + io.retriedCommands();
+    IOStatsN[STATS_STALE].value = io.staleFrames();
+    IOStatsN[STATS_DROPPED].value = io.droppedEvents();
+    IOStatsN[STATS_REPLY_TIMEOUT].value = io.currentTimeout();
+    IOStatsN[STATS_CRC_ERRORS].value = io.crcErrors();
+    IOStatsN[STATS_RECONNECTS].value = reconnects;
+    IOStatsN[STATS_PREEMPTED].value = io.preemptedRequests();
+    IOStatsN[STATS_SKIPPED_WRITES].value = skippedWrites;
+    IDSetNumber(&IOStatsNP, nullptr);
+
+    TimerHitN[LATENCY_P50].value = timerHitLatency.percentile(0.5) / 1000.0;
+    TimerHitN[LATENCY_P99].value = timerHitLatency.percentile(0.99) / 1000.0;
+    TimerHitN[LATENCY_MAX].value = timerHitLatency.maximum() / 1000.0;
+    IDSetNumber(&TimerHitNP, nullptr);
+
+    char summary[MAXRBUF] = {0};
+    commandStats.summary(summary, MAXRBUF);
+    IUSaveText(&LatencyT[0], summary);
+    IDSetText(&LatencyTP, nullptr);
+
+    if (TraceS[INDI_ENABLED].s == ISS_ON && trace.changed())
+        writeTrace();
+}
+
+void AstroStep::writeTrace()
+{
+    char path[MAXRBUF] = {0};
+    devicePath("_trace.txt", path, MAXRBUF);
+    if (!trace.write(path))
+        LOGF_WARN("Failed to write trace file %s.", path);
+}
+
+void AstroStep::recordTelemetry(uint32_t latency)
+{
+    if (!telemetry.isOpen())
+        return;
+
+    TelemetryLog::Sample sample;
+    sample.position = static_cast<int32_t>(measuredPos);
+    sample.target = static_cast<int32_t>(targetPos);
+    sample.temperature = static_cast<float>(TemperatureN[0].value);
+    sample.moving = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY || FocusTimerNP.s == IPS_BUSY) ? 1 : 0;
+    sample.filter = static_cast<uint8_t>(compensationFilter());
+    sample.latency = latency;
+    telemetry.record(sample);
+}
+
+void AstroStep::updateFeed()
+{
+    if (!feed.isOpen())
+        return;
+
+    PositionFeed::State state;
+    state.position = static_cast<int32_t>(measuredPos);
+    state.target = static_cast<int32_t>(targetPos);
+    state.temperature = static_cast<float>(TemperatureN[0].value);
+    // A move counts from the moment it is queued for the controller
+    state.moving = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY || FocusTimerNP.s == IPS_BUSY ||
+                    moveInFlight) ? 1 : 0;
+    state.online = linkDown ? 0 : 1;
+    feed.publish(state);
+}
+
+void AstroStep::processStatus(bool positionRC, bool temperatureRC, bool moving, uint32_t sequence)
+{
+    if (positionRC)
+    {
+        if (fabs(static_cast<double>(lastPos) - measuredPos) > 5)
+        {
+            publisher.update(&FocusAbsPosNP);
+            lastPos = measuredPos;
+        }
+    }
+
+    if (temperatureRC)
+    {
+        if (fabs(lastTemperature - TemperatureN[0].value) >= 0.5)
+        {
+            publisher.update(&TemperatureNP);
+            lastTemperature = TemperatureN[0].value;
+        }
+
+        checkHostCompensation();
+    }
+
+    // A move issued after this poll was queued is not reflected in its replies.
+    bool isBusy = (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY || FocusTimerNP.s == IPS_BUSY);
+    if (isBusy && !moving && sequence == moveSequence && !moveInFlight && !hasQueuedMove)
+    {
+        motion.stop();
+        prediction.stop();
+
+        // The controller ended the timed move, or it reached the travel limit first.
+        if (FocusTimerNP.s == IPS_BUSY)
+        {
+            endTimedMove(IPS_OK);
+            FocusAbsPosN[0].value = measuredPos;
+            publisher.update(&FocusAbsPosNP);
+            lastPos = measuredPos;
+            LOG_INFO("Timed move complete.");
+            return;
+        }
+
+        // Overshoot done, now approach the target from the backlash side.
+        if (backlashPending)
+        {
+            backlashPending = false;
+            MoveFocuser(targetPos);
+            return;
+        }
+
+        // The prediction may have been shown last.
+        FocusAbsPosN[0].value = measuredPos;
+        FocusAbsPosNP.s = IPS_OK;
+        FocusRelPosNP.s = IPS_OK;
+        publisher.update(&FocusAbsPosNP);
+        publisher.update(&FocusRelPosNP);
+        lastPos = measuredPos;
+        LOG_INFO("Focuser reached requested position.");
+
+        if (sweepActive)
+            sweepStepReached();
+    }
+}
+
+bool AstroStep::AbortFocuser()
+{
+    backlashPending = hasQueuedMove = false;
+    // The next move is not part of the burst that was stopped.
+    nextMoveWrite = std::chrono::steady_clock::time_point();
+    motion.stop();
+    prediction.stop();
+    endTimedMove(IPS_IDLE);
+    stopSweep(IPS_IDLE, "Focus sweep aborted.");
+
+    return queueCommand(":FQ#", [this](bool success)
+    {
+        if (!success)
+        {
+            FocusAbortSP.s = IPS_ALERT;
+            IDSetSwitch(&FocusAbortSP, nullptr);
+        }
+    });
+}
+
+bool AstroStep::saveConfigItems(FILE * fp)
+{
+    Focuser::saveConfigItems(fp);
+
+    IUSaveConfigNumber(fp, &PollingNP);
+    IUSaveConfigSwitch(fp, &TemperatureFilterSP);
+    IUSaveConfigNumber(fp, &TemperatureFilterNP);
+    IUSaveConfigSwitch(fp, &FastConnectSP);
+    IUSaveConfigSwitch(fp, &BinaryProtocolSP);
+    IUSaveConfigSwitch(fp, &AutoReconnectSP);
+    IUSaveConfigSwitch(fp, &TraceSP);
+    IUSaveConfigSwitch(fp, &TelemetrySP);
+    IUSaveConfigSwitch(fp, &FeedSP);
+    IUSaveConfigNumber(fp, &StreamNP);
+    IUSaveConfigNumber(fp, &PublishRateNP);
+    IUSaveConfigNumber(fp, &MotionDeadbandNP);
+    IUSaveConfigNumber(fp, &PredictionNP);
+    IUSaveConfigSwitch(fp, &SpeedProfileSP);
+    IUSaveConfigNumber(fp, &SpeedProfileNP);
+    IUSaveConfigSwitch(fp, &HostCompensateSP);
+    IUSaveConfigNumber(fp, &CompensationSettingsNP);
+
+    // The registers go with the config, the next fast connect then skips reading them.
+    if (isConnected() && FastConnectS[INDI_ENABLED].s == ISS_ON && firmwareVersion > 0)
+        saveParamCache();
 
     return true;
 }
 
+bool AstroStep::sendCommand(const char * cmd, char * res, bool silent)
+{
+    auto request = std::make_shared<IORequest>();
+    if (!request->add(cmd, res != nullptr))
+        return false;
+
+    io.execute(request);
+    logRequest(*request, silent);
+
+    if (request->status != IORequest::IO_OK)
+        return false;
+
+    if (res != nullptr)
+        strncpy(res, request->res[0], ML_RES - 1);
+
+    return true;
+}
+
+bool AstroStep::queueCommands(const char * const cmds[], int count, bool reply, std::function<void(IORequest &)> done,
+                              bool silent)
+{
+    auto request = std::make_shared<IORequest>();
+    for (int i = 0; i < count; i++)
+        request->add(cmds[i], reply);
+
+    request->onComplete = [this, done, silent](IORequest & completed)
+    {
+        logRequest(completed, silent);
+        if (done)
+            done(completed);
+    };
+
+    if (!io.isOpen())
+    {
+        request->status = IORequest::IO_CANCELLED;
+        if (done)
+            done(*request);
+        return false;
+    }
+
+    io.submit(request);
+    return true;
+}
+
+bool AstroStep::queueCommand(const char * cmd, std::function<void(bool)> done)
+{
+    const char * cmds[] = {cmd};
+
+    return queueCommands(cmds, 1, false, [done](IORequest & request)
+    {
+        if (done)
+            done(request.status == IORequest::IO_OK);
+    });
+}
+
+void AstroStep::logRequest(const IORequest &request, bool silent)
+{
+    double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    bool tracing = TraceS[INDI_ENABLED].s == ISS_ON;
+
+    for (int i = 0; i < request.count && i < request.written; i++)
+    {
+        LOGF_DEBUG("CMD <%s>", request.cmd[i]);
+        if (request.received[i])
+        {
+            LOGF_DEBUG("RES <%s>", request.res[i]);
+            commandStats.recordReply(request.cmd[i], request.latency[i]);
+        }
+        else if (request.status == IORequest::IO_TIMEOUT && i == request.failed)
+            commandStats.recordTimeout(request.cmd[i]);
+
+        if (tracing)
+            trace.add(now, request.cmd[i], request.received[i] ? request.res[i] : nullptr, request.latency[i],
+                      (i == request.failed) ? request.status : IORequest::IO_OK);
+    }
+
+    checkLink(request);
+
+    if (silent || request.status == IORequest::IO_OK || request.status == IORequest::IO_CANCELLED)
+        return;
+
+    const char * cmd = (request.failed >= 0 && request.failed < request.count) ? request.cmd[request.failed] : "";
+    if (request.status == IORequest::IO_WRITE_ERROR)
+        LOGF_ERROR("%s Serial write error.", cmd);
+    else if (request.status == IORequest::IO_TIMEOUT)
+        LOGF_ERROR("%s Serial read error: Timeout error.", cmd);
+    else
+        LOGF_ERROR("%s Serial read error.", cmd);
+}
+
+void AstroStep::checkLink(const IORequest &request)
+{
+    // Failures while connecting or reconnecting are the handshake's business.
+    if (!isConnected() || linkDown)
+        return;
+
+    switch (request.status)
+    {
+        case IORequest::IO_OK:
+            linkFailures = 0;
+            break;
+
+        case IORequest::IO_WRITE_ERROR:
+        case IORequest::IO_READ_ERROR:
+        case IORequest::IO_TIMEOUT:
+            linkFailures++;
+            if (linkFailures >= ML_LINK_FAILURES)
+                linkLost("no replies");
+            else if (request.status == IORequest::IO_READ_ERROR)
+                // The port itself failed (unplugged, closed by the peer), no use waiting for more.
+                linkLost("port error");
+            break;
+
+        default:
+            break;
+    }
+}
+
+void AstroStep::linkLost(const char * reason)
+{
+    if (AutoReconnectS[INDI_ENABLED].s != ISS_ON)
+        return;
+
+    linkDown = true;
+    LOGF_WARN("Link to the controller lost (%s), reconnecting.", reason);
+
+    // Requests still queued are dropped by close(), end what depended on them.
+    io.close();
+    pollPending = moveInFlight = hasQueuedMove = backlashPending = false;
+    motion.stop();
+    prediction.stop();
+    stopSweep(IPS_ALERT, "Focus sweep stopped, link to the controller lost.");
+    endTimedMove(IPS_ALERT);
+    if (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY)
+    {
+        FocusAbsPosNP.s = FocusRelPosNP.s = IPS_ALERT;
+        publisher.update(&FocusAbsPosNP);
+        publisher.update(&FocusRelPosNP);
+    }
+
+    reconnectDelay = ML_RECONNECT_MIN;
+    if (reconnectTimerID < 0)
+        reconnectTimerID = IEAddTimer(reconnectDelay, &AstroStep::reconnectHelper, this);
+}
+
+void AstroStep::reconnectHelper(void * context)
+{
+    static_cast<AstroStep *>(context)->reconnectCallback();
+}
+
+void AstroStep::reconnectCallback()
+{
+    reconnectTimerID = -1;
+    if (!linkDown)
+        return;
+
+    // Release the dead port. Opening it again can take seconds (a USB adapter enumerating,
+    // a TCP connect), so that runs on a thread of its own. The shared I/O thread would stall
+    // the other focusers, and the main loop this one.
+    getActiveConnection()->Disconnect();
+    closeReopenedPort();
+    stopReconnect();
+
+    if (reconnectPipe[0] < 0)
+    {
+        if (pipe(reconnectPipe) != 0)
+        {
+            reconnectFailed();
+            return;
+        }
+        reconnectCallbackID = IEAddCallback(reconnectPipe[0], &AstroStep::reconnectOpenedHelper, this);
+    }
+
+    bool tcp = getActiveConnection() == tcpConnection;
+    bool udp = tcp && tcpConnection->connectionType() == Connection::TCP::TYPE_UDP;
+    std::string address = tcp ? tcpConnection->host() : serialConnection->port();
+    uint32_t number = tcp ? tcpConnection->port() : serialConnection->baud();
+    int notify = reconnectPipe[1];
+    auto attempt = std::make_shared<ReconnectAttempt>();
+    reconnectAttempt = attempt;
+
+    std::thread([tcp, udp, address, number, notify, attempt]()
+    {
+        int fd = tcp ? openSocket(address.c_str(), number, udp) : openSerial(address.c_str(), number);
+
+        // Held while writing, so the driver cannot abandon the attempt and close the pipe meanwhile.
+        std::lock_guard<std::mutex> guard(attempt->lock);
+        if ((attempt->abandoned || ::write(notify, &fd, sizeof(fd)) != sizeof(fd)) && fd >= 0)
+            close(fd);
+    }).detach();
+}
+
+int AstroStep::openSerial(const char * port, uint32_t baud)
+{
+    int fd = -1;
+    if (tty_connect(port, static_cast<int>(baud), 8, 0, 1, &fd) != TTY_OK)
+        return -1;
+    return fd;
+}
+
+int AstroStep::openSocket(const char * host, uint32_t port, bool udp)
+{
+    struct addrinfo hints, *result = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+
+    char service[16] = {0};
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &result) != 0)
+        return -1;
+
+    int fd = -1;
+    for (struct addrinfo * address = result; address != nullptr && fd < 0; address = address->ai_next)
+    {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+void AstroStep::reconnectOpenedHelper(int fd, void * context)
+{
+    INDI_UNUSED(fd);
+    static_cast<AstroStep *>(context)->reconnectOpened();
+}
+
+void AstroStep::reconnectOpened()
+{
+    int fd = -1;
+    if (read(reconnectPipe[0], &fd, sizeof(fd)) != sizeof(fd))
+        return;
+    stopReconnect();
+
+    if (!linkDown)
+    {
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    if (fd < 0)
+    {
+        reconnectFailed();
+        return;
+    }
+
+    // The connection plugin closed its port, this one is the driver's to close.
+    reopenedFD = PortFD = fd;
+    resetLink();
+    if (!io.open(PortFD))
+    {
+        reconnectFailed();
+        return;
+    }
+    reconnectHandshake(0);
+}
+
+void AstroStep::reconnectHandshake(int attempt)
+{
+    // The handshake of Ack(), queued on the I/O thread instead of waited for.
+    io.setAdaptiveTimeout(false, 0);
+    io.setRetries(0);
+    io.setBinary(false);
+    io.setTimeout(ML_HANDSHAKE_TIMEOUT << attempt);
+    if (attempt > 0)
+        retries++;
+
+    const char * cmds[] = {":GV#"};
+    queueCommands(cmds, 1, true, [this, attempt](IORequest & request)
+    {
+        if (!linkDown)
+            return;
+
+        if (request.status != IORequest::IO_OK)
+        {
+            if (attempt + 1 < ML_HANDSHAKE_RETRIES)
+                reconnectHandshake(attempt + 1);
+            else
+                reconnectFailed();
+            return;
+        }
+
+        applyVersion(request.res[0]);
+        io.setTimeout(ML_TIMEOUT * 1000);
+        if (!binarySupported || BinaryProtocolS[INDI_ENABLED].s != ISS_ON)
+        {
+            endHandshake();
+            restoreLink();
+            return;
+        }
+
+        // Same probe as negotiateBinary().
+        io.setBinary(true);
+        const char * probeCmds[] = {":GV#"};
+        queueCommands(probeCmds, 1, true, [this](IORequest & probe)
+        {
+            if (!linkDown)
+                return;
+
+            if (probe.status == IORequest::IO_OK)
+                LOG_INFO("Using the binary protocol.");
+            else
+            {
+                io.setBinary(false);
+                LOG_WARN("Controller did not answer in the binary protocol, staying with ASCII.");
+            }
+            endHandshake();
+            restoreLink();
+        }, true);
+    }, true);
+}
+
+void AstroStep::reconnectFailed()
+{
+    io.close();
+    closeReopenedPort();
+
+    reconnectDelay = std::min(reconnectDelay * 2, static_cast<int>(ML_RECONNECT_MAX));
+    LOGF_DEBUG("Reconnect failed, next attempt in %d ms.", reconnectDelay);
+    reconnectTimerID = IEAddTimer(reconnectDelay, &AstroStep::reconnectHelper, this);
+}
+
+void AstroStep::stopReconnect()
+{
+    // Only takes the lock, the thread never holds it while opening the port.
+    if (reconnectAttempt)
+    {
+        std::lock_guard<std::mutex> guard(reconnectAttempt->lock);
+        reconnectAttempt->abandoned = true;
+    }
+    reconnectAttempt.reset();
+
+    // A port handed back before the attempt was abandoned, but not picked up.
+    int fd = -1;
+    struct pollfd pfd = { reconnectPipe[0], POLLIN, 0 };
+    while (reconnectPipe[0] >= 0 && poll(&pfd, 1, 0) > 0 && read(reconnectPipe[0], &fd, sizeof(fd)) == sizeof(fd))
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+void AstroStep::closeReopenedPort()
+{
+    if (reopenedFD < 0)
+        return;
+
+    close(reopenedFD);
+    if (PortFD == reopenedFD)
+        PortFD = -1;
+    reopenedFD = -1;
+}
+
+void AstroStep::restoreLink()
+{
+    linkDown = false;
+    linkFailures = 0;
+    reconnects++;
+    uint32_t expected = measuredPos;
+
+    // The controller may have been reset with the port, which loses its settings. Writing
+    // them back is cheaper than reading them.
+    // The handshake cleared the registers, so every write below is sent.
+    setSpeed(static_cast<uint32_t>(FocusSpeedN[0].value));
+    setCoilPowerState(CoilPowerS[COIL_POWER_ON].s == ISS_ON ? COIL_POWER_ON : COIL_POWER_OFF);
+    ReverseFocuser(FocusReverseS[INDI_ENABLED].s == ISS_ON);
+    setTemperatureCalibration(TemperatureSettingN[0].value);
+    setTemperatureCoefficient(TemperatureSettingN[1].value);
+    setTemperatureCompensation(TemperatureCompensateS[0].s == ISS_ON);
+    enableEvents();
+    if (profilesSupported)
+        uploadSpeedProfiles();
+
+    // Only the position is read, to tell whether the controller kept its state.
+    const char * cmds[] = {":GP#"};
+    queueCommands(cmds, 1, true, [this, expected](IORequest & request)
+    {
+        ReplyParser::Values values;
+        if (!parseReply(request, 0, values))
+            return;
+
+        // A reset controller starts from zero, the focuser has not actually moved.
+        uint32_t position = static_cast<uint32_t>(values.get(ReplyParser::FIELD_POSITION));
+        if (position == 0 && expected != 0)
+        {
+            LOGF_WARN("Reconnected, controller was reset, syncing it back to %u.", expected);
+            auto cmd = Command::SYNC.encode(static_cast<int32_t>(expected));
+            queueCommand(cmd.text);
+            return;
+        }
+
+        // Anything else is where the motor is, it may have been moved while the link was down.
+        if (position != expected)
+            LOGF_WARN("Reconnected, controller reports %u instead of %u.", position, expected);
+        else
+            LOG_INFO("Reconnected to the controller.");
+        applyReply(values);
+        publisher.update(&FocusAbsPosNP);
+        lastPos = measuredPos;
+    });
+}
+
+void AstroStep::ioDispatchHelper(int fd, void * context)
+{
+    INDI_UNUSED(fd);
+    auto driver = static_cast<AstroStep *>(context);
+    driver->io.dispatch();
+    driver->publisher.flush();
+}
+
 int AstroStep::msleep( long duration)
 {
     struct timespec ts;
@@ -21,26 +21,47 @@
 #pragma once
 
 #include "indifocuser.h"
+#include "astrostep_command.h"
+#include "astrostep_compensation.h"
+#include "astrostep_feed.h"
+#include "astrostep_io.h"
+#include "astrostep_motion.h"
+#include "astrostep_publisher.h"
+#include "astrostep_registers.h"
+#include "astrostep_reply.h"
+#include "astrostep_stats.h"
+#include "astrostep_telemetry.h"
 
 #include <time.h>
 
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 class AstroStep : public INDI::Focuser
 {
     public:
         AstroStep();
-        virtual ~AstroStep() override = default;
+        virtual ~AstroStep() override;
 
         typedef enum {COIL_POWER_OFF, COIL_POWER_ON } CoilPower;
 
         const char * getDefaultName() override;
         virtual bool initProperties() override;
+        virtual void ISGetProperties(const char * dev) override;
         virtual bool updateProperties() override;
         virtual bool ISNewNumber(const char * dev, const char * name, double values[], char * names[], int n) override;
         virtual bool ISNewSwitch(const char * dev, const char * name, ISState * states, char * names[], int n) override;
 
         static void timedMoveHelper(void * context);
+        static void predictionHelper(void * context);
+        static void settleHelper(void * context);
+        static void sweepHelper(void * context);
+        static void reconnectHelper(void * context);
+        static void reconnectOpenedHelper(int fd, void * context);
 
     protected:
         /**
@@ -48,6 +69,7 @@ class AstroStep : public INDI::Focuser
          * @return True if communication is successful, false otherwise.
          */
         virtual bool Handshake() override;
+        virtual bool Disconnect() override;
 
         /**
          * @brief MoveFocuser Move focuser in a specific direction and speed for period of time.
@@ -83,53 +105,211 @@ class AstroStep : public INDI::Focuser
         virtual bool SetFocuserSpeed(int speed) override;
         virtual bool ReverseFocuser(bool enabled) override;
         virtual bool AbortFocuser() override;
+        virtual bool SetFocuserBacklash(int32_t steps) override;
+        virtual bool SetFocuserBacklashEnabled(bool enabled) override;
         virtual void TimerHit() override;
         virtual bool saveConfigItems(FILE * fp) override;
 
     private:
         bool Ack();
         /**
-         * @brief sendCommand Send a string command to AstroStep.
+         * @brief sendCommand Send a string command to AstroStep and wait for the outcome.
          * @param cmd Command to be sent, must already have the necessary delimeter ('#')
          * @param res If not nullptr, the function will read until it detects the default delimeter ('#') up to ML_RES length.
          *        if nullptr, no read back is done and the function returns true.
          * @param silent if true, do not print any error messages.
-         * @param nret if > 0 read nret chars, otherwise read to the terminator
          * @return True if successful, false otherwise.
+         * @note Blocks the caller, only used while connecting before the event loop takes over.
          */
-        bool sendCommand(const char * cmd, char * res = nullptr, bool silent = false, int nret = 0);
+        bool sendCommand(const char * cmd, char * res = nullptr, bool silent = false);
 
-        // Get initial focuser parameter when we first connect
+        /**
+         * @brief queueCommands Queue a batch of commands on the I/O thread.
+         * @param cmds Commands to be sent, each must already have the necessary delimeter ('#')
+         * @param count Number of commands in the batch.
+         * @param reply True if the controller answers each of the commands.
+         * @param done Called from the INDI event loop once the batch completed. Replies that did not arrive are
+         *        left empty. Also called immediately if the controller is not connected.
+         * @param silent if true, do not print any error messages.
+         * @return True if the batch was queued, false otherwise.
+         */
+        bool queueCommands(const char * const cmds[], int count, bool reply, std::function<void(IORequest &)> done,
+                           bool silent = false);
+
+        /**
+         * @brief queueCommand Queue a single command without reply.
+         * @param done If set, called from the INDI event loop with the outcome of the command.
+         * @return True if the command was queued, false otherwise.
+         */
+        bool queueCommand(const char * cmd, std::function<void(bool)> done = nullptr);
+
+        // Log the exchange and any error of a completed request
+        void logRequest(const IORequest &request, bool silent);
+        // Run completion callbacks on the INDI event loop
+        static void ioDispatchHelper(int fd, void * context);
+
+        // Get initial focuser parameter when we first connect, settings already known are skipped
         void GetFocusParams();
-        // Read and update Temperature
-        bool readTemperature();
-        // Read and update Position
-        bool readPosition();
-        // Read and update speed
-        bool readSpeed();
+        // Last position and registers of this device, for fast connect
+        bool loadParamCache();
+        void saveParamCache();
+        /**
+         * @brief writeRegister Send cmd unless reg already holds value. done runs at once,
+         * successfully, for a skipped write.
+         */
+        bool writeRegister(DeviceRegisters::Register reg, int32_t value, const char * cmd,
+                           std::function<void(bool)> done);
+        // Position stream and done events, which a reset controller no longer sends
+        void enableEvents();
         // Read version
         bool readVersion();
-        // Are we moving?
-        bool isMoving();
-        // Read coil power state
-        bool readCoilPowerState();
-        // Read reverse
-        bool readReverseDirection();
-        // Read temperature coefficient
-        bool readTemperatureCoefficient();
-        // Read temperature calibation
-        bool readTemperatureCalibration();
+        // Features of the firmware version reply res
+        void applyVersion(const char * res);
+        // Timeouts and retries used once the handshake is over
+        void endHandshake();
+        // State of the link a new port starts from
+        void resetLink();
+        // Switch to the binary framing if the controller answers in it
+        bool negotiateBinary();
 
+        // Decode reply index of request through the command table, logs malformed replies
+        bool parseReply(const IORequest &request, int index, ReplyParser::Values &values);
+        // Copy decoded position and settings into their properties, publishing changed settings
+        void applyReply(const ReplyParser::Values &values);
+        // Filter a new temperature sample into TemperatureN
+        void addTemperatureSample(double temperature);
+        // Active filter slot of the host compensation, zero based
+        int compensationFilter() const;
+        // Per device file under ~/.indi
+        void devicePath(const char * suffix, char * path, size_t len);
+        // Fit the model of the active filter and publish it
+        void updateCompensationModel();
+        // Issue a corrective move once the temperature drift exceeds the deadband
+        void checkHostCompensation();
+        // 0 stops the position stream
+        bool setStreamInterval(uint32_t interval, std::function<void(bool)> done = nullptr);
+        // Unsolicited frame pushed by the controller
+        void processEvent(const char * frame);
+        // Refresh the diagnostics properties and the trace file
+        void updateDiagnostics();
+        void writeTrace();
+        // Append the current state to the telemetry file, latency of the reply behind it if any
+        void recordTelemetry(uint32_t latency = 0);
+        // Publish the current state to the shared memory feed, if enabled
+        void updateFeed();
+        // Count failed requests, the link is declared lost after ML_LINK_FAILURES in a row
+        void checkLink(const IORequest &request);
+        void linkLost(const char * reason);
+        // Reopen the port, with a growing delay between attempts
+        void reconnectCallback();
+        // Called by the reconnect thread, a file descriptor of -1 if the port did not open
+        static int openSerial(const char * port, uint32_t baud);
+        static int openSocket(const char * host, uint32_t port, bool udp);
+        // The reconnect thread handed back the port
+        void reconnectOpened();
+        // Ack() on the reopened port, attempt counts from zero
+        void reconnectHandshake(int attempt);
+        // Close the reopened port and schedule the next attempt
+        void reconnectFailed();
+        // Abandon the reconnect thread without waiting for it, and close a port it handed back too late
+        void stopReconnect();
+        void closeReopenedPort();
+        // Confirm the position and write back settings the controller may have lost
+        void restoreLink();
+        // Queue a status poll, the temperature only if due
+        void pollStatus(bool temperatureDue);
+        // Publish a completed poll
+        void processStatus(bool positionRC, bool temperatureRC, bool moving, uint32_t sequence);
+
+        // Send a move, or replace the target of one that is not sent yet
         bool MoveFocuser(uint32_t position);
-        bool setSpeed(uint32_t speed);
-        bool setTemperatureCalibration(uint32_t calibration);
-        bool setTemperatureCoefficient(uint32_t coefficient);
-        bool setTemperatureCompensation(bool enable);
+        // Write the commands of a move to position
+        bool sendMove(uint32_t position);
+        // Send the target held back by MoveFocuser() once the coalescing window has passed
+        void flushQueuedMove();
+        // Apply the deadband and backlash to a client move
+        IPState planMove(uint32_t target);
+        bool setSpeed(uint32_t speed, std::function<void(bool)> done = nullptr);
+        // Define the slew and approach profiles on the controller
+        bool uploadSpeedProfiles(std::function<void(bool)> done = nullptr);
+        // Profile for a move to position: slew for long moves, approach for short ones, 0 without profiles
+        int moveProfile(uint32_t position) const;
+        bool setTemperatureCalibration(uint32_t calibration, std::function<void(bool)> done = nullptr);
+        bool setTemperatureCoefficient(uint32_t coefficient, std::function<void(bool)> done = nullptr);
+        bool setTemperatureCompensation(bool enable, std::function<void(bool)> done = nullptr);
         void timedMoveCallback();
-        bool setGotoHome();
-        bool setCoilPowerState(CoilPower enable);
+        // Stop the watchdog and publish the end of a timed move in progress
+        void endTimedMove(IPState state);
+        // Start the profile of a move to target and the timer publishing it
+        void startPrediction(uint32_t target, int profile);
+        void predictionCallback();
+        // Take the next sample of a settling move one moving poll period after the last one
+        void scheduleSettlePoll();
+        void settleCallback();
+        // Plan the sweep from FocusSweepN and move to its first step
+        bool startSweep();
+        void sweepMove();
+        // The move of the current step ended
+        void sweepStepReached();
+        void sweepReadySignal();
+        void sweepCallback();
+        void stopSweep(IPState state, const char * reason);
+        bool setGotoHome(std::function<void(bool)> done = nullptr);
+        bool setCoilPowerState(CoilPower enable, std::function<void(bool)> done = nullptr);
+
+        uint32_t targetPos { 0 }, lastPos { 0 };
+        // Position last read from the controller. FocusAbsPosN shows the predicted one during a move.
+        uint32_t measuredPos { 0 };
+        double lastTemperature { 0 };
+
+        // Firmware version encoded as major * 10000 + minor * 100 + patch
+        uint32_t firmwareVersion { 0 };
+        // Firmware answers the combined :GS# status query
+        bool statusSupported { false };
+        // Firmware parses several queued commands per read
+        bool pipelineSupported { false };
+        // Firmware accepts the target position with :FG#
+        bool gotoSupported { false };
+        // Firmware stops timed moves itself (:FT#)
+        bool timedSupported { false };
+        // Firmware pushes the position while moving (:SS#)
+        bool streamSupported { false };
+        // Firmware reports the end of a move with a !D frame (:SF#)
+        bool doneSupported { false };
+        // Firmware answers BinaryProtocol frames
+        bool binarySupported { false };
+        // Firmware keeps speed profiles (:SY#, :SL#)
+        bool profilesSupported { false };
+        // Profile selected on the controller, -1 if unknown
+        int selectedProfile { -1 };
+        // Settings held by the controller, to skip redundant writes
+        DeviceRegisters registers;
+        uint32_t skippedWrites { 0 };
+        // Last streamed frame, or the start of the last move
+        std::chrono::steady_clock::time_point lastStreamFrame;
+        int timedMoveTimerID { -1 };
 
-        uint32_t targetPos { 0 }, lastPos { 0 }, lastTemperature { 0 };
+        // Serial traffic runs on its own thread
+        IOLoop io;
+        int ioCallbackID { -1 };
+        // A poll request is queued and not completed yet
+        bool pollPending { false };
+        // Incremented on every move, so polls queued before it do not end it
+        uint32_t moveSequence { 0 };
+        // Ends moves from the reported positions, so :GI# is rarely needed
+        MotionTracker motion;
+        int settleTimerID { -1 };
+        // A move command is queued and not acknowledged yet
+        bool moveInFlight { false };
+        // Target received meanwhile, sent once the pending move is acknowledged and a poll tick
+        // has passed since it was written
+        bool hasQueuedMove { false };
+        uint32_t queuedMove { 0 };
+        std::chrono::steady_clock::time_point nextMoveWrite;
+        // Overshoot move in progress, targetPos is approached once it ends
+        bool backlashPending { false };
+        // Next idle position poll and next temperature sample
+        std::chrono::steady_clock::time_point nextPoll, nextTemperaturePoll;
 
         // Read Only Temperature Reporting
         INumber TemperatureN[1];
@@ -151,12 +331,284 @@ class AstroStep : public INDI::Focuser
         ISwitch CoilPowerS[2];
         ISwitchVectorProperty CoilPowerSP;
 
+        // Temperature filter
+        ISwitch TemperatureFilterS[3];
+        ISwitchVectorProperty TemperatureFilterSP;
+        enum
+        {
+            FILTER_NONE,
+            FILTER_EXPONENTIAL,
+            FILTER_MEDIAN,
+        };
+
+        INumber TemperatureFilterN[2];
+        INumberVectorProperty TemperatureFilterNP;
+        enum
+        {
+            FILTER_ALPHA,
+            FILTER_WINDOW,
+        };
+
+        // Last known parameters, shown while connecting
+        ISwitch FastConnectS[2];
+        ISwitchVectorProperty FastConnectSP;
+        // Cached parameters are shown and not verified yet
+        bool cachedParams { false };
+
+        // Use the binary framing when the firmware has it
+        ISwitch BinaryProtocolS[2];
+        ISwitchVectorProperty BinaryProtocolSP;
+
+        // Position stream interval
+        INumber StreamN[1];
+        INumberVectorProperty StreamNP;
+
+        // Maximum rate of value updates per property
+        INumber PublishRateN[1];
+        INumberVectorProperty PublishRateNP;
+        PropertyPublisher publisher;
+
+        // Moves shorter than this are skipped
+        INumber MotionDeadbandN[1];
+        INumberVectorProperty MotionDeadbandNP;
+
+        // Speed and acceleration profiles kept on the controller, chosen per move by distance
+        ISwitch SpeedProfileS[2];
+        ISwitchVectorProperty SpeedProfileSP;
+        INumber SpeedProfileN[5];
+        INumberVectorProperty SpeedProfileNP;
+        enum
+        {
+            PROFILE_SLEW_SPEED,
+            PROFILE_SLEW_ACCELERATION,
+            PROFILE_APPROACH_SPEED,
+            PROFILE_APPROACH_ACCELERATION,
+            PROFILE_DISTANCE,
+        };
+        static const int ML_PROFILE_SLEW { 1 };
+        static const int ML_PROFILE_APPROACH { 2 };
+
+        // Interpolated positions published between polls
+        INumber PredictionN[2];
+        INumberVectorProperty PredictionNP;
+        enum
+        {
+            PREDICT_INTERVAL,
+            PREDICT_ACCELERATION,
+        };
+        MotionModel prediction;
+        int predictionTimerID { -1 };
+        // The poll at the predicted end of the move was sent
+        bool predictionPolled { false };
+
+        // Focus sweep: planned positions run back to back, each one signalled ready for an exposure
+        INumber FocusSweepN[5];
+        INumberVectorProperty FocusSweepNP;
+        enum
+        {
+            SWEEP_START,
+            SWEEP_STEP,
+            SWEEP_COUNT,
+            SWEEP_SETTLE,
+            SWEEP_DWELL,
+        };
+        INumber SweepStatusN[3];
+        INumberVectorProperty SweepStatusNP;
+        enum
+        {
+            SWEEP_INDEX,
+            SWEEP_POSITION,
+            SWEEP_READY_TIME,
+        };
+        ISwitch SweepControlS[2];
+        ISwitchVectorProperty SweepControlSP;
+        enum
+        {
+            SWEEP_NEXT,
+            SWEEP_ABORT,
+        };
+        static const int ML_SWEEP_MAX { 200 };
+        uint32_t sweepPositions[ML_SWEEP_MAX] = {0};
+        int sweepCount { 0 };
+        int sweepIndex { 0 };
+        bool sweepActive { false };
+        // The current step is reached and settled
+        bool sweepReady { false };
+        int sweepTimerID { -1 };
+
+        // Host temperature compensation
+        ISwitch HostCompensateS[2];
+        ISwitchVectorProperty HostCompensateSP;
+
+        INumber CompensationSettingsN[3];
+        INumberVectorProperty CompensationSettingsNP;
+        enum
+        {
+            COMPENSATION_FILTER,
+            COMPENSATION_DEADBAND,
+            COMPENSATION_ORDER,
+        };
+
+        ISwitch CompensationRecordS[2];
+        ISwitchVectorProperty CompensationRecordSP;
+        enum
+        {
+            COMPENSATION_RECORD,
+            COMPENSATION_CLEAR,
+        };
+
+        INumber CompensationModelN[4];
+        INumberVectorProperty CompensationModelNP;
+        enum
+        {
+            MODEL_POINTS,
+            MODEL_C0,
+            MODEL_C1,
+            MODEL_C2,
+        };
+
+        TemperatureModel temperatureModel;
+        // Focus held by the host compensation and the temperature it was found at
+        bool compensationReferenceValid { false };
+        double compensationReferencePosition { 0 }, compensationReferenceTemperature { 0 };
+        // Set while the compensation itself issues a move
+        bool compensationMove { false };
+
+        // Reopen the port when the link drops
+        ISwitch AutoReconnectS[2];
+        ISwitchVectorProperty AutoReconnectSP;
+        // Requests failed in a row
+        int linkFailures { 0 };
+        // The port is closed and being reopened
+        bool linkDown { false };
+        int reconnectTimerID { -1 };
+        // The port is opened by a detached thread, which writes its file descriptor to
+        // reconnectPipe. Once its attempt is abandoned the thread closes the port itself and
+        // never touches the pipe again, so nothing has to wait for it.
+        struct ReconnectAttempt
+        {
+            std::mutex lock;
+            bool abandoned { false };
+        };
+        std::shared_ptr<ReconnectAttempt> reconnectAttempt;
+        int reconnectPipe[2] { -1, -1 };
+        int reconnectCallbackID { -1 };
+        // Port opened by a reconnect, owned by the driver rather than the connection plugin
+        int reopenedFD { -1 };
+        int reconnectDelay { 0 };
+        uint32_t reconnects { 0 };
+
+        // Serial I/O diagnostics
+        INumber IOStatsN[11];
+        INumberVectorProperty IOStatsNP;
+        enum
+        {
+            STATS_BYTES_IN,
+            STATS_BYTES_OUT,
+            STATS_TIMEOUTS,
+            STATS_RETRIES,
+            STATS_STALE,
+            STATS_DROPPED,
+            STATS_REPLY_TIMEOUT,
+            STATS_CRC_ERRORS,
+            STATS_RECONNECTS,
+            STATS_PREEMPTED,
+            STATS_SKIPPED_WRITES,
+        };
+
+        // Time spent in TimerHit
+        INumber TimerHitN[3];
+        INumberVectorProperty TimerHitNP;
+        enum
+        {
+            LATENCY_P50,
+            LATENCY_P99,
+            LATENCY_MAX,
+        };
+
+        IText LatencyT[1];
+        ITextVectorProperty LatencyTP;
+
+        ISwitch TraceS[2];
+        ISwitchVectorProperty TraceSP;
+
+        // Motion and temperature history in a ring file
+        ISwitch TelemetryS[2];
+        ISwitchVectorProperty TelemetrySP;
+        TelemetryLog telemetry;
+
+        // Focuser state for other processes on this host
+        ISwitch FeedS[2];
+        ISwitchVectorProperty FeedSP;
+        PositionFeed feed;
+
+        CommandStats commandStats;
+        LatencyHistogram timerHitLatency;
+        TraceRing trace;
+        uint32_t retries { 0 };
+        std::chrono::steady_clock::time_point nextDiagnostics;
+
+        // Polling rates
+        INumber PollingN[2];
+        INumberVectorProperty PollingNP;
+        enum
+        {
+            POLL_MOVING,
+            POLL_TEMPERATURE,
+        };
+
         // AstroStep Buffer
         static const uint8_t ML_RES { 32 };
         // AstroStep Delimeter
         static const char ML_DEL { '#' };
-        // AstroStep Timeout
+        // AstroStep Timeout, the ceiling of the adaptive reply timeout
         static const uint8_t ML_TIMEOUT { 3 };
+        // Added to the measured round trip timeout in milliseconds, per link type
+        static const int ML_SERIAL_MARGIN { 50 };
+        static const int ML_TCP_MARGIN { 100 };
+        // Times a timed out query is sent again
+        static const int ML_QUERY_RETRIES { 2 };
+        // First handshake reply timeout in milliseconds, doubled on every retry
+        static const int ML_HANDSHAKE_TIMEOUT { 250 };
+        static const int ML_HANDSHAKE_RETRIES { 4 };
+        // Maximum number of temperature samples for the median filter
+        static const int ML_TEMPERATURE_WINDOW { 15 };
+        // First firmware version supporting the combined status query (0.1.0)
+        static const uint32_t ML_FW_STATUS { 100 };
+        // First firmware version accepting pipelined commands (0.2.0)
+        static const uint32_t ML_FW_PIPELINE { 200 };
+        // First firmware version accepting a target position with :FG# (0.3.0)
+        static const uint32_t ML_FW_GOTO { 300 };
+        // First firmware version timing moves on the controller (0.4.0)
+        static const uint32_t ML_FW_TIMED { 400 };
+        // Extra time given to the controller before the host aborts a timed move, in milliseconds
+        static const uint16_t ML_TIMED_WATCHDOG { 250 };
+        // First firmware version streaming the position while moving (0.5.0)
+        static const uint32_t ML_FW_STREAM { 500 };
+        // First firmware version sending a move done frame (0.6.0)
+        static const uint32_t ML_FW_DONE { 600 };
+        // First firmware version accepting binary frames (0.7.0)
+        static const uint32_t ML_FW_BINARY { 700 };
+        // First firmware version keeping speed profiles (0.8.0)
+        static const uint32_t ML_FW_PROFILES { 800 };
+        // Failed requests in a row that mark the link lost
+        static const int ML_LINK_FAILURES { 3 };
+        // First and longest delay between reconnect attempts, in milliseconds
+        static const int ML_RECONNECT_MIN { 1000 };
+        static const int ML_RECONNECT_MAX { 30000 };
+        // Diagnostics refresh period in milliseconds
+        static const int ML_DIAGNOSTICS_PERIOD { 2000 };
+        // Firmware speed limit in steps per second (setMaxSpeed)
+        static constexpr double ML_MAX_SPEED { 12800 };
+        // Samples kept in the telemetry file, about a week of idle polling
+        static const uint32_t ML_TELEMETRY_SAMPLES { 131072 };
+        // Silence allowed on the position stream on top of four intervals, in milliseconds
+        static const int ML_STREAM_GRACE { 500 };
+
+        // Recent raw temperature samples and the exponential average
+        double temperatureSamples[ML_TEMPERATURE_WINDOW] = {0};
+        uint32_t temperatureSampleCount { 0 };
+        double temperatureAverage { 0 };
 
         int msleep(long milliseconds);
 };
\ No newline at end of file